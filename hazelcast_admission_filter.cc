@@ -0,0 +1,158 @@
+#include "hazelcast_admission_filter.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "absl/time/time.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+// Finalizer of SplitMix64. Hash keys are hashes already, but rows
+// need independent indices.
+uint64_t mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+const uint8_t MAX_COUNT = std::numeric_limits<uint8_t>::max();
+
+}
+
+HazelcastAdmissionFilter::HazelcastAdmissionFilter(
+    const AdmissionConfig& config)
+  : min_requests_(config.min_requests()),
+  sample_size_(config.sample_size() > 0 ? config.sample_size() :
+      DEFAULT_SAMPLE_SIZE),
+  shared_(!config.shared_map_name().empty()),
+  sync_interval_(config.shared_sync_interval_ms() > 0 ?
+      config.shared_sync_interval_ms() : DEFAULT_SYNC_INTERVAL_MS) {
+  // A counter per sampled miss and row, rounded up to a power of two.
+  uint64_t width = 1;
+  while (width < sample_size_) width <<= 1;
+  width_mask_ = width - 1;
+  if (enabled()) {
+    counters_ = std::vector<std::atomic<uint8_t>>(DEPTH * width);
+  }
+}
+
+size_t HazelcastAdmissionFilter::index(uint64_t hash_key, size_t row) const {
+  return row * (width_mask_ + 1) +
+      (mix(hash_key + row * 0x9e3779b97f4a7c15ULL) & width_mask_);
+}
+
+uint32_t HazelcastAdmissionFilter::increment(uint64_t hash_key) {
+  uint32_t count = MAX_COUNT;
+  for (size_t row = 0; row < DEPTH; row++) {
+    std::atomic<uint8_t>& counter = counters_[index(hash_key, row)];
+    uint8_t value = counter.load(std::memory_order_relaxed);
+    while (value < MAX_COUNT && !counter.compare_exchange_weak(value,
+        value + 1, std::memory_order_relaxed)) {}
+    count = std::min<uint32_t>(count, value < MAX_COUNT ? value + 1 : value);
+  }
+  if (++increments_ % sample_size_ == 0) {
+    age();
+  }
+  return count;
+}
+
+uint32_t HazelcastAdmissionFilter::estimate(uint64_t hash_key) const {
+  uint32_t count = MAX_COUNT;
+  for (size_t row = 0; row < DEPTH; row++) {
+    count = std::min<uint32_t>(count,
+        counters_[index(hash_key, row)].load(std::memory_order_relaxed));
+  }
+  return count;
+}
+
+bool HazelcastAdmissionFilter::admit(uint64_t count) {
+  if (count >= min_requests_) {
+    admitted_++;
+    return true;
+  }
+  rejected_++;
+  return false;
+}
+
+void HazelcastAdmissionFilter::age() {
+  for (std::atomic<uint8_t>& counter : counters_) {
+    counter.store(counter.load(std::memory_order_relaxed) >> 1,
+        std::memory_order_relaxed);
+  }
+}
+
+void HazelcastAdmissionFilter::raise(uint64_t hash_key, uint64_t count) {
+  const uint8_t target = std::min<uint64_t>(count, MAX_COUNT);
+  for (size_t row = 0; row < DEPTH; row++) {
+    std::atomic<uint8_t>& counter = counters_[index(hash_key, row)];
+    uint8_t value = counter.load(std::memory_order_relaxed);
+    while (value < target && !counter.compare_exchange_weak(value, target,
+        std::memory_order_relaxed)) {}
+  }
+}
+
+void HazelcastAdmissionFilter::recordShared(uint64_t hash_key) {
+  PendingMisses& pending = pending_.local();
+  absl::MutexLock lock(&pending.mutex);
+  if (pending.misses.size() < MAX_PENDING_KEYS ||
+      pending.misses.contains(hash_key)) {
+    pending.misses[hash_key]++;
+  }
+}
+
+void HazelcastAdmissionFilter::syncShared(StorageBackend& backend) {
+  absl::flat_hash_map<uint64_t, uint64_t> misses;
+  pending_.forEach([&misses](PendingMisses& pending) {
+    absl::MutexLock lock(&pending.mutex);
+    for (const auto& key_misses : pending.misses) {
+      misses[key_misses.first] += key_misses.second;
+    }
+    pending.misses.clear();
+  });
+  for (const auto& key_misses : misses) {
+    const uint64_t hash_key = key_misses.first;
+    backend.addRequestCount(hash_key, key_misses.second,
+        [this, hash_key](uint64_t count) {
+      // Includes the misses of this Envoy, hence not added.
+      raise(hash_key, count);
+    });
+  }
+}
+
+HazelcastSharedAdmission::HazelcastSharedAdmission(
+    HazelcastAdmissionFilter& filter, StorageBackend& backend)
+  : filter_(filter), backend_(backend) {
+  syncer_ = std::thread([this]() { run(); });
+}
+
+HazelcastSharedAdmission::~HazelcastSharedAdmission() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  // The background thread syncs the remaining misses on exit.
+  syncer_.join();
+}
+
+void HazelcastSharedAdmission::run() {
+  bool stopping = false;
+  while (!stopping) {
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.AwaitWithTimeout(absl::Condition(&stopping_),
+          absl::FromChrono(filter_.syncInterval()));
+      stopping = stopping_;
+    }
+    filter_.syncShared(backend_);
+  }
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
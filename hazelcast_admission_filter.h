@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "hazelcast_storage_backend.h"
+#include "hazelcast_thread_shards.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Admission policy of the insert path: a response is inserted only
+ * once its key has missed min_requests times recently. Keys requested
+ * once (one-hit wonders) then never reach the cluster, neither taking
+ * the bandwidth to insert them nor evicting entries served again.
+ *
+ * Misses are counted on a count-min sketch of the Envoy: each key
+ * increments a counter in each of four rows, and its count is
+ * estimated by the smallest of them. Collisions may only overestimate
+ * a count. All counters are halved after sample_size misses, hence
+ * old requests fade out. Counters are updated without locking by all
+ * workers; increments racing with halving may be lost, which only
+ * delays an admission.
+ *
+ * If shared_map_name is set, misses are counted on the cluster as
+ * well (see StorageBackend::addRequestCount), so a key requested
+ * through different Envoys is admitted too. Workers do not wait for
+ * the cluster: they count on the sketch and record the miss, and
+ * HazelcastSharedAdmission adds the recorded misses to the cluster
+ * counts in the background. The counts returned raise the counters of
+ * the sketch, hence misses through other Envoys count here after a
+ * sync interval.
+ */
+class HazelcastAdmissionFilter {
+public:
+  HazelcastAdmissionFilter(const AdmissionConfig& config);
+
+  // False if every response is inserted.
+  bool enabled() const { return min_requests_ > 1; }
+  bool shared() const { return shared_; }
+
+  // Counts a miss of the key on the sketch and returns the estimated
+  // number of its recent misses, including this one. The sketch is
+  // only allocated if enabled.
+  uint32_t increment(uint64_t hash_key);
+  uint32_t estimate(uint64_t hash_key) const;
+
+  // Records a miss to be added to the shared count of the key. Misses
+  // are dropped while a worker has MAX_PENDING_KEYS keys pending,
+  // which only delays admissions.
+  void recordShared(uint64_t hash_key);
+  // Adds the recorded misses to the shared counts, and raises the
+  // counters of each key to its shared count.
+  void syncShared(StorageBackend& backend);
+  // Interval of the syncs, see HazelcastSharedAdmission.
+  std::chrono::milliseconds syncInterval() const { return sync_interval_; }
+
+  // True if a key with the given miss count is inserted. Counted in
+  // the stats below.
+  bool admit(uint64_t count);
+
+  uint64_t admitted() const { return admitted_.load(); }
+  uint64_t rejected() const { return rejected_.load(); }
+
+  static const uint32_t DEFAULT_SAMPLE_SIZE = 100000;
+  static const uint32_t DEFAULT_SYNC_INTERVAL_MS = 1000;
+  static const size_t MAX_PENDING_KEYS = 65536;
+
+private:
+  static const size_t DEPTH = 4;
+
+  // Misses of a worker not synced yet, by key.
+  struct PendingMisses {
+    absl::Mutex mutex;
+    absl::flat_hash_map<uint64_t, uint64_t> misses GUARDED_BY(mutex);
+  };
+
+  size_t index(uint64_t hash_key, size_t row) const;
+  // Halves all counters.
+  void age();
+  // Raises the counters of the key to at least count.
+  void raise(uint64_t hash_key, uint64_t count);
+
+  const uint32_t min_requests_;
+  const uint64_t sample_size_;
+  const bool shared_;
+  const std::chrono::milliseconds sync_interval_;
+  // Rows of the sketch, each of width_mask_ + 1 saturating counters.
+  uint64_t width_mask_;
+  std::vector<std::atomic<uint8_t>> counters_;
+  std::atomic<uint64_t> increments_{0};
+
+  std::atomic<uint64_t> admitted_{0};
+  std::atomic<uint64_t> rejected_{0};
+
+  HazelcastThreadShards<PendingMisses> pending_;
+};
+
+/**
+ * Background thread of a shared admission filter: syncs the recorded
+ * misses every sync interval, and once more on destruction.
+ */
+class HazelcastSharedAdmission {
+public:
+  HazelcastSharedAdmission(HazelcastAdmissionFilter& filter,
+      StorageBackend& backend);
+  ~HazelcastSharedAdmission();
+
+private:
+  // Loop of the background thread.
+  void run();
+
+  HazelcastAdmissionFilter& filter_;
+  StorageBackend& backend_;
+
+  absl::Mutex mutex_;
+  bool stopping_ GUARDED_BY(mutex_) = false;
+  std::thread syncer_;
+};
+
+using HazelcastSharedAdmissionPtr = std::unique_ptr<HazelcastSharedAdmission>;
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
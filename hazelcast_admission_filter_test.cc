@@ -0,0 +1,87 @@
+#include <thread>
+
+#include "hazelcast_admission_filter.h"
+#include "hazelcast_local_backend.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+TEST(HazelcastAdmissionFilterTest, CountsAndAging) {
+  AdmissionConfig config;
+  config.set_min_requests(3);
+  config.set_sample_size(64);
+  HazelcastAdmissionFilter filter(config);
+  ASSERT_TRUE(filter.enabled());
+  EXPECT_FALSE(filter.shared());
+
+  EXPECT_EQ(1, filter.increment(1));
+  EXPECT_EQ(2, filter.increment(1));
+  EXPECT_FALSE(filter.admit(2));
+  EXPECT_TRUE(filter.admit(filter.increment(1)));
+  EXPECT_EQ(3, filter.estimate(1));
+  // Counts of other keys are not affected unless they collide in all
+  // rows, which is unlikely.
+  EXPECT_EQ(0, filter.estimate(2));
+
+  // Halved on the sample_size-th increment.
+  for (int i = 3; i < 64; i++) {
+    filter.increment(1);
+  }
+  EXPECT_EQ(32, filter.estimate(1));
+  EXPECT_FALSE(HazelcastAdmissionFilter(AdmissionConfig()).enabled());
+}
+
+TEST(HazelcastAdmissionFilterTest, SharedCounts) {
+  AdmissionConfig config;
+  config.set_min_requests(3);
+  config.set_shared_map_name("admission");
+  config.set_shared_sync_interval_ms(60000);
+  HazelcastAdmissionFilter filter(config);
+  ASSERT_TRUE(filter.shared());
+  LocalStorageBackend backend;
+
+  // Counted by another Envoy.
+  backend.addRequestCount(1, 2, [](uint64_t count) {
+    EXPECT_EQ(2, count);
+  });
+  EXPECT_EQ(1, filter.increment(1));
+  filter.recordShared(1);
+  filter.recordShared(1);
+  filter.syncShared(backend);
+  EXPECT_EQ(4, filter.estimate(1));
+  backend.addRequestCount(1, 0, [](uint64_t count) {
+    EXPECT_EQ(4, count);
+  });
+  // Synced once only.
+  filter.syncShared(backend);
+  EXPECT_EQ(4, filter.estimate(1));
+
+  // Pending misses are synced on destruction of the background thread.
+  filter.recordShared(2);
+  {
+    HazelcastSharedAdmission syncer(filter, backend);
+  }
+  EXPECT_EQ(1, filter.estimate(2));
+}
+
+TEST(HazelcastAdmissionFilterTest, LocalCountsExpire) {
+  LocalStorageBackend backend(std::chrono::milliseconds(10));
+  uint64_t count = 0;
+  backend.addRequestCount(1, 2, [&count](uint64_t total) { count = total; });
+  backend.addRequestCount(1, 1, [&count](uint64_t total) { count = total; });
+  EXPECT_EQ(3, count);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  backend.addRequestCount(1, 1, [&count](uint64_t total) { count = total; });
+  EXPECT_EQ(1, count);
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
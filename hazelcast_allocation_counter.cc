@@ -0,0 +1,52 @@
+#include "hazelcast_allocation_counter.h"
+
+#include <atomic>
+
+#ifdef TCMALLOC
+#include "gperftools/malloc_hook.h"
+#endif
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+
+#ifdef TCMALLOC
+void countAllocation(const void*, size_t) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+}
+
+AllocationCounter::AllocationCounter() : start_(total()) {};
+
+uint64_t AllocationCounter::allocations() const {
+  return total() - start_;
+}
+
+void AllocationCounter::reset() {
+  start_ = total();
+}
+
+bool AllocationCounter::supported() {
+#ifdef TCMALLOC
+  static const bool installed = MallocHook::AddNewHook(&countAllocation);
+  return installed;
+#else
+  return false;
+#endif
+}
+
+uint64_t AllocationCounter::total() {
+  return supported() ? allocation_count.load(std::memory_order_relaxed) : 0;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
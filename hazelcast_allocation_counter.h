@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Counts heap allocations made by all threads of the process.
+ *
+ * Allocations are counted by a new hook of tcmalloc (gperftools), so
+ * that operator new is not replaced and the binary keeps a single
+ * allocator. Without tcmalloc, i.e. with --define tcmalloc=disabled,
+ * nothing is counted and supported() is false.
+ */
+class AllocationCounter {
+public:
+  AllocationCounter();
+
+  // Allocations since construction or the last reset().
+  uint64_t allocations() const;
+  void reset();
+
+  // True if allocations are counted. Installs the hook on first call.
+  static bool supported();
+
+  // Allocations since the hook is installed.
+  static uint64_t total();
+
+private:
+  uint64_t start_;
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,218 @@
+#include "hazelcast_body_codec.h"
+
+#include <algorithm>
+
+#include "common/common/assert.h"
+#include "common/http/headers.h"
+#include "absl/container/fixed_array.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+// Window bits of zlib for gzip format (15 + 16) and for raw deflate
+// data, i.e. the partitions after the first one.
+const int GZIP_WINDOW_BITS = 31;
+const int RAW_WINDOW_BITS = -15;
+const int MEMORY_LEVEL = 8;
+const size_t CHUNK_SIZE = 16384;
+
+// Same as the defaults of the gzip filter.
+const std::vector<std::string> DEFAULT_CONTENT_TYPES{
+    "application/javascript", "application/json", "application/xhtml+xml",
+    "image/svg+xml", "text/css", "text/html", "text/plain", "text/xml"};
+
+// Media type of a Content-Type value without parameters, lower case.
+std::string mediaType(absl::string_view content_type) {
+  std::string media_type(absl::StripAsciiWhitespace(
+      content_type.substr(0, content_type.find(';'))));
+  absl::AsciiStrToLower(&media_type);
+  return media_type;
+}
+
+}
+
+/// HazelcastBodyCodecs
+
+HazelcastBodyCodecs::HazelcastBodyCodecs(const BodyCompressionConfig& config)
+  : codec_(config.codec() == BodyCompressionConfig::GZIP ?
+      HazelcastBodyCodec::Gzip : HazelcastBodyCodec::None),
+  min_size_(config.min_size()),
+  store_identity_(config.store_identity()) {
+  for (const std::string& content_type : config.content_types()) {
+    content_types_.push_back(mediaType(content_type));
+  }
+  if (content_types_.empty()) {
+    content_types_ = DEFAULT_CONTENT_TYPES;
+  }
+}
+
+HazelcastBodyCodec HazelcastBodyCodecs::codecFor(
+    const Http::HeaderMap& response_headers) const {
+  if (codec_ == HazelcastBodyCodec::None) {
+    return HazelcastBodyCodec::None;
+  }
+  const Http::HeaderEntry* content_encoding =
+      response_headers.ContentEncoding();
+  if (content_encoding && !absl::EqualsIgnoreCase(
+      content_encoding->value().getStringView(),
+      Http::Headers::get().ContentEncodingValues.Identity)) {
+    // Already encoded by upstream.
+    return HazelcastBodyCodec::None;
+  }
+  const Http::HeaderEntry* content_type = response_headers.ContentType();
+  if (!content_type ||
+      !allowedContentType(content_type->value().getStringView())) {
+    return HazelcastBodyCodec::None;
+  }
+  const Http::HeaderEntry* content_length = response_headers.ContentLength();
+  uint64_t length;
+  if (content_length && absl::SimpleAtoi(
+      content_length->value().getStringView(), &length) &&
+      length < min_size_) {
+    return HazelcastBodyCodec::None;
+  }
+  return codec_;
+}
+
+bool HazelcastBodyCodecs::allowedContentType(
+    absl::string_view content_type) const {
+  const std::string media_type = mediaType(content_type);
+  for (const std::string& allowed : content_types_) {
+    if (allowed == media_type || (absl::EndsWith(allowed, "/*") &&
+        absl::StartsWith(media_type, allowed.substr(0, allowed.size() - 1)))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HazelcastBodyCodecs::decompress(HazelcastBodyCodec codec,
+    const std::vector<hazelcast::byte>& partition, uint64_t body_index,
+    Buffer::Instance& output) {
+  ASSERT(codec == HazelcastBodyCodec::Gzip);
+  z_stream zstream{};
+  // Only the first partition starts with the gzip header.
+  if (inflateInit2(&zstream, body_index == 0 ? GZIP_WINDOW_BITS :
+      RAW_WINDOW_BITS) != Z_OK) {
+    return false;
+  }
+  zstream.next_in = const_cast<hazelcast::byte*>(partition.data());
+  zstream.avail_in = partition.size();
+  unsigned char chunk[CHUNK_SIZE];
+  int result;
+  do {
+    zstream.next_out = chunk;
+    zstream.avail_out = CHUNK_SIZE;
+    result = inflate(&zstream, Z_NO_FLUSH);
+    if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+      break;
+    }
+    output.add(chunk, CHUNK_SIZE - zstream.avail_out);
+    // The partition ends at a flush point unless it is the last one,
+    // hence Z_BUF_ERROR (no progress possible) ends the partition.
+  } while (result == Z_OK && (zstream.avail_in > 0 ||
+      zstream.avail_out == 0));
+  inflateEnd(&zstream);
+  return result == Z_OK || result == Z_STREAM_END || result == Z_BUF_ERROR;
+}
+
+absl::string_view HazelcastBodyCodecs::encodingName(HazelcastBodyCodec codec) {
+  switch (codec) {
+  case HazelcastBodyCodec::Gzip:
+    return Http::Headers::get().ContentEncodingValues.Gzip;
+  default:
+    return Http::Headers::get().ContentEncodingValues.Identity;
+  }
+}
+
+bool HazelcastBodyCodecs::accepts(absl::string_view accept_encoding,
+    HazelcastBodyCodec codec) {
+  if (codec == HazelcastBodyCodec::None) {
+    return true;
+  }
+  // The token of the codec decides wherever it is listed, e.g.
+  // "*;q=0, gzip" accepts gzip and "gzip;q=0, *" does not. The wildcard
+  // applies only to codings not listed.
+  const absl::string_view name = encodingName(codec);
+  absl::optional<double> codec_quality;
+  absl::optional<double> wildcard_quality;
+  for (absl::string_view item : absl::StrSplit(accept_encoding, ',')) {
+    std::vector<absl::string_view> params = absl::StrSplit(item, ';');
+    const absl::string_view coding = absl::StripAsciiWhitespace(params[0]);
+    const bool wildcard = coding == "*";
+    if (!wildcard && !absl::EqualsIgnoreCase(coding, name)) {
+      continue;
+    }
+    double quality = 1;
+    for (size_t i = 1; i < params.size(); i++) {
+      const absl::string_view param = absl::StripAsciiWhitespace(params[i]);
+      if (absl::StartsWithIgnoreCase(param, "q=") &&
+          !absl::SimpleAtod(param.substr(2), &quality)) {
+        quality = 0;
+      }
+    }
+    absl::optional<double>& listed = wildcard ? wildcard_quality :
+        codec_quality;
+    // Of repeated tokens, the lowest quality wins.
+    listed = listed ? std::min(*listed, quality) : quality;
+  }
+  if (codec_quality) {
+    return *codec_quality > 0;
+  }
+  return wildcard_quality && *wildcard_quality > 0;
+}
+
+/// HazelcastBodyCompressor
+
+HazelcastBodyCompressor::HazelcastBodyCompressor(HazelcastBodyCodec codec)
+  : zstream_{} {
+  ASSERT(codec == HazelcastBodyCodec::Gzip);
+  const int result = deflateInit2(&zstream_, Z_DEFAULT_COMPRESSION,
+      Z_DEFLATED, GZIP_WINDOW_BITS, MEMORY_LEVEL, Z_DEFAULT_STRATEGY);
+  RELEASE_ASSERT(result == Z_OK, "deflateInit2 failed");
+}
+
+HazelcastBodyCompressor::~HazelcastBodyCompressor() {
+  deflateEnd(&zstream_);
+}
+
+void HazelcastBodyCompressor::compress(const Buffer::Instance& partition,
+    std::vector<hazelcast::byte>& compressed, bool last) {
+  const uint64_t num_slices = partition.getRawSlices(nullptr, 0);
+  absl::FixedArray<Buffer::RawSlice> slices(num_slices);
+  partition.getRawSlices(slices.begin(), num_slices);
+  compressed.clear();
+  // An empty partition still needs the flush.
+  uint64_t i = 0;
+  do {
+    const bool last_slice = i + 1 >= num_slices;
+    zstream_.next_in = num_slices == 0 ? nullptr :
+        static_cast<hazelcast::byte*>(slices[i].mem_);
+    zstream_.avail_in = num_slices == 0 ? 0 : slices[i].len_;
+    const int flush = !last_slice ? Z_NO_FLUSH : last ? Z_FINISH :
+        Z_FULL_FLUSH;
+    do {
+      const size_t offset = compressed.size();
+      compressed.resize(offset + zstream_.avail_in / 2 + CHUNK_SIZE);
+      zstream_.next_out = compressed.data() + offset;
+      zstream_.avail_out = compressed.size() - offset;
+      const int result = deflate(&zstream_, flush);
+      RELEASE_ASSERT(result != Z_STREAM_ERROR, "deflate failed");
+      compressed.resize(compressed.size() - zstream_.avail_out);
+    } while (zstream_.avail_out == 0);
+  } while (++i < num_slices);
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
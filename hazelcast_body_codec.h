@@ -0,0 +1,99 @@
+#pragma once
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/http/header_map.h"
+#include "hazelcast_cache_entry.h"
+#include "hazelcast.pb.h"
+
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Compression of the body partitions.
+ *
+ * A response body is compressed as a single gzip stream which is
+ * fully flushed at each partition boundary. Hence:
+ *
+ *  - Each compressed partition holds exactly the bytes of the same
+ *    partition of an uncompressed entry, so partition indices of a
+ *    range are computed the same way for both.
+ *  - A partition can be decompressed on its own since a full flush
+ *    resets the compression history.
+ *  - The concatenation of the partitions is a regular gzip body,
+ *    which is served as is to clients accepting it. Whether they do
+ *    is read from the request headers, which lookups made without
+ *    them (as the filter's are, see HazelcastHttpCache) do not have.
+ *    Such lookups always decompress, hence store_identity pays off
+ *    for them, not for compression alone.
+ *
+ * The codec of an entry is recorded in HazelcastHeaderEntry.
+ */
+class HazelcastBodyCodecs {
+public:
+  HazelcastBodyCodecs(const BodyCompressionConfig& config);
+
+  // Codec to store a response with the given headers. None is returned
+  // if compression is disabled, the response is already encoded, its
+  // content type is not allowed or its content length is known to be
+  // smaller than the minimum size.
+  HazelcastBodyCodec codecFor(const Http::HeaderMap& response_headers) const;
+
+  // Responses smaller than this are stored uncompressed.
+  uint64_t minSize() const { return min_size_; }
+
+  // True if the uncompressed partitions of compressed responses are
+  // stored as an additional representation.
+  bool storeIdentity() const { return store_identity_; }
+
+  // Appends the decompressed bytes of the partition to the output.
+  // Returns false if the partition cannot be decoded.
+  static bool decompress(HazelcastBodyCodec codec,
+      const std::vector<hazelcast::byte>& partition, uint64_t body_index,
+      Buffer::Instance& output);
+
+  // Content-Encoding token of the codec.
+  static absl::string_view encodingName(HazelcastBodyCodec codec);
+
+  // True if the given Accept-Encoding value accepts the codec with a
+  // non zero quality. The quality of the codec's own token takes
+  // precedence over the one of "*".
+  static bool accepts(absl::string_view accept_encoding,
+      HazelcastBodyCodec codec);
+
+private:
+  bool allowedContentType(absl::string_view content_type) const;
+
+  const HazelcastBodyCodec codec_;
+  const uint64_t min_size_;
+  const bool store_identity_;
+  std::vector<std::string> content_types_;
+};
+
+/**
+ * Compression stream of a single response body. Partitions have to
+ * be passed in order, the last one with last set.
+ */
+class HazelcastBodyCompressor {
+public:
+  HazelcastBodyCompressor(HazelcastBodyCodec codec);
+  ~HazelcastBodyCompressor();
+
+  // Writes the compressed form of the partition to compressed, reading
+  // the partition from its slices.
+  void compress(const Buffer::Instance& partition,
+      std::vector<hazelcast::byte>& compressed, bool last);
+
+private:
+  z_stream zstream_;
+};
+
+using HazelcastBodyCompressorPtr = std::unique_ptr<HazelcastBodyCompressor>;
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
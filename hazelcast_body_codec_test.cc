@@ -0,0 +1,40 @@
+#include "hazelcast_body_codec.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+TEST(HazelcastBodyCodecsTest, AcceptEncoding) {
+  const HazelcastBodyCodec gzip = HazelcastBodyCodec::Gzip;
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("gzip", gzip));
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("deflate, GZIP;q=0.5", gzip));
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("*", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("br", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("gzip;q=0", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("gzip; q=0.000", gzip));
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("", HazelcastBodyCodec::None));
+}
+
+// The token of the codec decides, wherever the wildcard is listed.
+TEST(HazelcastBodyCodecsTest, ExclusionsBeforeWildcard) {
+  const HazelcastBodyCodec gzip = HazelcastBodyCodec::Gzip;
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("*;q=0, gzip", gzip));
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("br;q=1.0, *;q=0, gzip;q=0.1",
+      gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("gzip;q=0, *", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("*, gzip;q=0", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("*;q=0", gzip));
+  EXPECT_FALSE(HazelcastBodyCodecs::accepts("br, *;q=0", gzip));
+  EXPECT_TRUE(HazelcastBodyCodecs::accepts("br, *;q=0.5", gzip));
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
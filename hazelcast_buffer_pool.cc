@@ -0,0 +1,99 @@
+#include "hazelcast_buffer_pool.h"
+
+#include <algorithm>
+
+#include "common/buffer/buffer_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+HazelcastBufferPool::HazelcastBufferPool(const BufferPoolConfig& config)
+  : max_idle_buffers_(config.max_idle_buffers()),
+  max_buffer_size_(config.max_buffer_size() > 0 ? config.max_buffer_size() :
+      DEFAULT_MAX_BUFFER_SIZE) {}
+
+HazelcastBufferPool::WorkerBuffers& HazelcastBufferPool::workerBuffers() {
+  return workers_.local();
+}
+
+std::vector<hazelcast::byte> HazelcastBufferPool::acquire(uint64_t size) {
+  buffers_in_use_++;
+  std::vector<hazelcast::byte> buffer;
+  if (enabled()) {
+    WorkerBuffers& worker = workerBuffers();
+    absl::MutexLock lock(&worker.mutex);
+    // Idle buffers are few, hence searched linearly.
+    auto it = std::find_if(worker.idle.begin(), worker.idle.end(),
+        [size](const std::vector<hazelcast::byte>& idle) {
+      return idle.capacity() >= size;
+    });
+    if (it != worker.idle.end()) {
+      buffer = std::move(*it);
+      *it = std::move(worker.idle.back());
+      worker.idle.pop_back();
+      idle_buffers_--;
+      idle_bytes_ -= buffer.capacity();
+      hits_++;
+      return buffer;
+    }
+  }
+  misses_++;
+  buffer.reserve(size);
+  return buffer;
+}
+
+void HazelcastBufferPool::release(std::vector<hazelcast::byte>&& buffer) {
+  if (!enabled()) {
+    buffers_in_use_--;
+    dropped_++;
+    return;
+  }
+  release(workerBuffers(), std::move(buffer));
+}
+
+void HazelcastBufferPool::release(WorkerBuffers& worker,
+    std::vector<hazelcast::byte>&& buffer) {
+  buffers_in_use_--;
+  if (buffer.capacity() > max_buffer_size_) {
+    dropped_++;
+    return;
+  }
+  buffer.clear();
+  absl::MutexLock lock(&worker.mutex);
+  if (worker.idle.size() >= max_idle_buffers_) {
+    dropped_++;
+    return;
+  }
+  idle_buffers_++;
+  idle_bytes_ += buffer.capacity();
+  worker.idle.push_back(std::move(buffer));
+}
+
+void HazelcastBufferPool::addFragment(std::vector<hazelcast::byte>&& buffer,
+    Buffer::Instance& output) {
+  if (buffer.empty()) {
+    release(std::move(buffer));
+    return;
+  }
+  WorkerBuffers* worker = enabled() ? &workerBuffers() : nullptr;
+  auto owned = std::make_shared<std::vector<hazelcast::byte>>(
+      std::move(buffer));
+  auto fragment = new Buffer::BufferFragmentImpl(owned->data(), owned->size(),
+      [this, worker, owned](const void*, size_t,
+          const Buffer::BufferFragmentImpl* fragment) {
+        if (worker) {
+          release(*worker, std::move(*owned));
+        } else {
+          release(std::move(*owned));
+        }
+        delete fragment;
+      });
+  output.addBufferFragment(*fragment);
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
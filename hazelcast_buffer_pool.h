@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "envoy/buffer/buffer.h"
+#include "hazelcast/util/HazelcastDll.h"
+#include "hazelcast_thread_shards.h"
+#include "hazelcast.pb.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Pool of partition sized buffers for the insert path.
+ *
+ * An insert context takes a buffer when a partition starts, fills it
+ * without reallocating since the buffer is reserved for the whole
+ * partition, and hands it to the body entry as a buffer fragment.
+ * The buffer comes back to the pool once the entry is serialized and
+ * drained. Hence buffers are reserved once and reused across inserts
+ * instead of being allocated and grown for each partition.
+ *
+ * Each thread has its own idle buffers. A buffer returns to the
+ * thread it was taken by, so workers do not contend on a shared list.
+ * The pool has to outlive the buffers taken from it.
+ */
+class HazelcastBufferPool {
+public:
+  HazelcastBufferPool(const BufferPoolConfig& config);
+
+  // False if buffers are not pooled. Then partitions are staged in
+  // Buffer::OwnedImpl slices.
+  bool enabled() const { return max_idle_buffers_ > 0; }
+
+  // True if a partition of the given size is staged in a pooled
+  // buffer. Larger partitions are not pooled.
+  bool pooled(uint64_t size) const {
+    return enabled() && size <= max_buffer_size_;
+  }
+
+  // An empty buffer with a capacity of at least size bytes. An idle
+  // buffer of the calling worker is reused if one is large enough.
+  std::vector<hazelcast::byte> acquire(uint64_t size);
+
+  // Returns a buffer taken by acquire. It is freed if the worker has
+  // max_idle_buffers already or the buffer is too large to pool.
+  void release(std::vector<hazelcast::byte>&& buffer);
+
+  // Moves the buffer content to the end of output without copying.
+  // The buffer is released once output drains it.
+  void addFragment(std::vector<hazelcast::byte>&& buffer,
+      Buffer::Instance& output);
+
+  // Occupancy of the pool, summed over the workers.
+  uint64_t idleBuffers() const { return idle_buffers_.load(); }
+  uint64_t idleBytes() const { return idle_bytes_.load(); }
+  uint64_t buffersInUse() const { return buffers_in_use_.load(); }
+
+  // Number of acquires served from idle buffers and by allocating, and
+  // number of released buffers freed instead of pooled.
+  uint64_t hits() const { return hits_.load(); }
+  uint64_t misses() const { return misses_.load(); }
+  uint64_t dropped() const { return dropped_.load(); }
+
+  static const uint64_t DEFAULT_MAX_BUFFER_SIZE = 4 * 1024 * 1024;
+
+private:
+  struct WorkerBuffers {
+    absl::Mutex mutex;
+    std::vector<std::vector<hazelcast::byte>> idle GUARDED_BY(mutex);
+  };
+
+  // Buffers of the calling worker.
+  WorkerBuffers& workerBuffers();
+  void release(WorkerBuffers& worker, std::vector<hazelcast::byte>&& buffer);
+
+  const uint32_t max_idle_buffers_;
+  const uint64_t max_buffer_size_;
+  HazelcastThreadShards<WorkerBuffers> workers_;
+
+  std::atomic<uint64_t> idle_buffers_{0};
+  std::atomic<uint64_t> idle_bytes_{0};
+  std::atomic<uint64_t> buffers_in_use_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
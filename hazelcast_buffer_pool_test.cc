@@ -0,0 +1,58 @@
+#include "common/buffer/buffer_impl.h"
+#include "hazelcast_buffer_pool.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+TEST(HazelcastBufferPoolTest, Limits) {
+  BufferPoolConfig config;
+  config.set_max_idle_buffers(1);
+  config.set_max_buffer_size(100);
+  HazelcastBufferPool pool(config);
+  ASSERT_TRUE(pool.enabled());
+  EXPECT_FALSE(pool.pooled(101));
+
+  std::vector<hazelcast::byte> first = pool.acquire(10);
+  std::vector<hazelcast::byte> second = pool.acquire(20);
+  EXPECT_GE(first.capacity(), 10u);
+  EXPECT_EQ(2, pool.buffersInUse());
+  pool.release(std::move(first));
+  // Only one idle buffer is kept.
+  pool.release(std::move(second));
+  EXPECT_EQ(1, pool.idleBuffers());
+  EXPECT_EQ(1, pool.dropped());
+
+  // Too small for the request.
+  std::vector<hazelcast::byte> large = pool.acquire(50);
+  EXPECT_EQ(3, pool.misses());
+  // Too large to pool.
+  large.reserve(200);
+  pool.release(std::move(large));
+  EXPECT_EQ(2, pool.dropped());
+
+  std::vector<hazelcast::byte> reused = pool.acquire(5);
+  EXPECT_EQ(1, pool.hits());
+  EXPECT_EQ(0, pool.idleBuffers());
+  EXPECT_EQ(0, pool.idleBytes());
+
+  // Released once the output drains the fragment.
+  reused.assign({'a', 'b', 'c'});
+  Buffer::OwnedImpl output;
+  pool.addFragment(std::move(reused), output);
+  EXPECT_EQ("abc", output.toString());
+  EXPECT_EQ(1, pool.buffersInUse());
+  output.drain(output.length());
+  EXPECT_EQ(0, pool.buffersInUse());
+  EXPECT_EQ(1, pool.idleBuffers());
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
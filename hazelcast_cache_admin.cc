@@ -0,0 +1,184 @@
+#include "hazelcast_cache_admin.h"
+
+#include "common/http/utility.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+const std::string HazelcastCacheAdmin::STATUS_PREFIX = "/hazelcast_cache";
+const std::string HazelcastCacheAdmin::INSPECT_PREFIX =
+    "/hazelcast_cache/inspect";
+
+HazelcastCacheAdmin::HazelcastCacheAdmin(HazelcastHttpCache& cache) :
+  hz_cache_(cache) {};
+
+void HazelcastCacheAdmin::registerHandlers(Server::Admin& admin) {
+  admin.addHandler(STATUS_PREFIX,
+      "print Hazelcast cache connection state and operation latencies",
+      MAKE_ADMIN_HANDLER(handlerStatus), false, false);
+  admin.addHandler(INSPECT_PREFIX,
+      "print the cached header entry of a key (?key=) or url (?host=&path=)",
+      MAKE_ADMIN_HANDLER(handlerInspect), false, false);
+}
+
+Http::Code HazelcastCacheAdmin::handlerStatus(absl::string_view,
+    Http::HeaderMap&, Buffer::Instance& response, Server::AdminStream&) {
+  const bool connected = hz_cache_.isConnected();
+  response.add(fmt::format("connected: {}\n", connected));
+  response.add(fmt::format("members: {}\n", connected ?
+      absl::StrJoin(hz_cache_.backend().memberAddresses(), ",") : ""));
+
+  HazelcastOperationStats& stats = hz_cache_.operationStats();
+  response.add(fmt::format("in_flight_operations: {}\n", stats.inFlight()));
+  const std::vector<double> percentiles{50, 90, 99, 99.9};
+  for (size_t i = 0; i < static_cast<size_t>(HazelcastOperation::Count); i++) {
+    HazelcastOperation operation = static_cast<HazelcastOperation>(i);
+    std::vector<uint64_t> latencies =
+        stats.latencyPercentiles(operation, percentiles);
+    response.add(fmt::format(
+        "{}: completed={} p50={}us p90={}us p99={}us p999={}us\n",
+        HazelcastOperationStats::operationName(operation),
+        stats.completed(operation), latencies[0], latencies[1], latencies[2],
+        latencies[3]));
+  }
+  const HazelcastBufferPool& pool = hz_cache_.bufferPool();
+  response.add(fmt::format("buffer_pool: idle={} idle_bytes={} in_use={} "
+      "hits={} misses={} dropped={}\n", pool.idleBuffers(), pool.idleBytes(),
+      pool.buffersInUse(), pool.hits(), pool.misses(), pool.dropped()));
+  const HazelcastMemoryBudget& budget = hz_cache_.memoryBudget();
+  if (budget.enabled()) {
+    response.add(fmt::format("insert_memory: used={} limit={}\n",
+        budget.used(), budget.limit()));
+  }
+  const HazelcastRateLimiter& rate_limiter = hz_cache_.rateLimiter();
+  if (rate_limiter.enabled()) {
+    response.add(fmt::format("insert_rate_limit: bytes_per_second={} "
+        "shared={}\n", rate_limiter.bytesPerSecond(), rate_limiter.shared()));
+  }
+  HazelcastInsertStats& insert_stats = hz_cache_.insertStats();
+  for (size_t i = 0; i < static_cast<size_t>(HazelcastInsertSkip::Count);
+      i++) {
+    HazelcastInsertSkip reason = static_cast<HazelcastInsertSkip>(i);
+    response.add(fmt::format("skipped_inserts_{}: {}\n",
+        HazelcastInsertStats::reasonName(reason),
+        insert_stats.skipped(reason)));
+  }
+  const HazelcastAdmissionFilter& admission = hz_cache_.admissionFilter();
+  if (admission.enabled()) {
+    response.add(fmt::format("admission: shared={} admitted={} "
+        "rejected={}\n", admission.shared(), admission.admitted(),
+        admission.rejected()));
+  }
+  if (const HazelcastWriteBehindQueue* queue = hz_cache_.writeBehind()) {
+    response.add(fmt::format("write_behind: queued={} queued_bytes={} "
+        "committed={} failed={} dropped={} rate_limited={} superseded={} "
+        "batches={}\n", queue->queuedInserts(), queue->queuedBytes(),
+        queue->committed(), queue->failed(), queue->dropped(),
+        queue->rateLimited(), queue->superseded(), queue->batches()));
+  }
+  return connected ? Http::Code::OK : Http::Code::ServiceUnavailable;
+}
+
+Http::Code HazelcastCacheAdmin::handlerInspect(absl::string_view path_and_query,
+    Http::HeaderMap&, Buffer::Instance& response, Server::AdminStream&) {
+  if (!hz_cache_.isConnected()) {
+    response.add("Hazelcast client is not connected\n");
+    return Http::Code::ServiceUnavailable;
+  }
+
+  Http::Utility::QueryParams params =
+      Http::Utility::parseQueryString(path_and_query);
+  uint64_t hash_key;
+  if (params.find("key") != params.end()) {
+    if (!absl::SimpleAtoi(params.at("key"), &hash_key)) {
+      response.add("key must be an unsigned 64 bit integer\n");
+      return Http::Code::BadRequest;
+    }
+  } else if (params.find("host") != params.end() &&
+      params.find("path") != params.end()) {
+    // Derive the key the same way the filter does.
+    Http::HeaderMapImpl request_headers;
+    request_headers.setHost(params.at("host"));
+    request_headers.setPath(params.at("path"));
+    request_headers.setForwardedProto(params.find("scheme") != params.end() ?
+        params.at("scheme") : Http::Headers::get().SchemeValues.Https);
+    LookupRequest request(request_headers, SystemTime());
+    hash_key = stableHashKey(request.key());
+  } else {
+    response.add("usage: ?key=<hash key> or ?host=<host>&path=<path>"
+        "[&scheme=<http|https>]\n");
+    return Http::Code::BadRequest;
+  }
+
+  response.add(fmt::format("hash_key: {}\n", hash_key));
+  HazelcastHeaderPtr header_entry;
+  hz_cache_.lookupHeader(hash_key,
+      [&header_entry](HazelcastHeaderPtr&& entry) {
+    header_entry = std::move(entry);
+  });
+  if (!header_entry) {
+    response.add("not found\n");
+    return Http::Code::NotFound;
+  }
+
+  const HazelcastPartitionSchedule& schedule =
+      hz_cache_.entrySchedule(*header_entry);
+  response.add(fmt::format("total_body_size: {}\n",
+      header_entry->total_body_size));
+  response.add(fmt::format("partition_count: {}\n",
+      schedule.count(header_entry->total_body_size)));
+  response.add(fmt::format("partition_sizes: first={} growth={} max={}\n",
+      schedule.firstSize(), schedule.growthFactor(), schedule.maxSize()));
+  response.add(fmt::format("body_codec: {}\n",
+      HazelcastBodyCodecs::encodingName(header_entry->body_codec)));
+  response.add(fmt::format("deduplicated: {}\n",
+      !header_entry->partition_keys.empty()));
+  for (const HazelcastRepresentation& representation :
+      header_entry->representations) {
+    response.add(fmt::format("representation: {} partitions={}\n",
+        HazelcastBodyCodecs::encodingName(representation.codec),
+        representation.partition_sizes.size()));
+  }
+  if (!header_entry->vary_spec.empty()) {
+    // Variants are stored under keys of the request header values.
+    response.add(fmt::format("vary_spec: {}\n",
+        absl::StrJoin(header_entry->vary_spec, ", ")));
+  }
+  if (header_entry->freshness) {
+    response.add(fmt::format("freshness_lifetime_s: {}\n",
+        header_entry->freshness->freshness_lifetime));
+  }
+
+  // Hazelcast reports Long.MAX_VALUE for entries without TTL.
+  const int64_t expiration_time =
+      hz_cache_.backend().headerExpirationTime(hash_key);
+  if (expiration_time < 0 ||
+      expiration_time == std::numeric_limits<int64_t>::max()) {
+    response.add("ttl_remaining_ms: none\n");
+  } else {
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    response.add(fmt::format("ttl_remaining_ms: {}\n",
+        std::max<int64_t>(expiration_time - now, 0)));
+  }
+
+  response.add("headers:\n");
+  header_entry->headerMap().iterate(
+      [](const Http::HeaderEntry& header, void* context) ->
+      Http::HeaderMap::Iterate {
+        static_cast<Buffer::Instance*>(context)->add(fmt::format("  {}: {}\n",
+            header.key().getStringView(), header.value().getStringView()));
+        return Http::HeaderMap::Iterate::Continue;
+      },
+      &response);
+  return Http::Code::OK;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "envoy/server/admin.h"
+#include "hazelcast_http_cache.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Admin handlers for Hazelcast cache introspection.
+ *
+ * /hazelcast_cache
+ *   Client connection state, cluster members, number of in flight
+ *   operations, latency percentiles of the recent operations,
+ *   occupancy of the insert buffer pool, the insert memory budget and
+ *   rate limit, the write-behind queue, responses admitted for
+ *   insertion and responses not stored per reason.
+ *
+ * /hazelcast_cache/inspect?key=<hash key>
+ * /hazelcast_cache/inspect?host=<host>&path=<path>[&scheme=<http|https>]
+ *   Stored header entry of the given cache key or URL: response headers,
+ *   total body size, number of body partitions and remaining TTL. The
+ *   entry is only read and not served, i.e. no body is fetched.
+ *
+ * The cache factory is not given the server context, hence it cannot
+ * register the handlers and the plugin does not link them. An embedder
+ * having the admin and the cache links hazelcast_cache_admin_lib and
+ * calls registerHandlers.
+ */
+class HazelcastCacheAdmin {
+public:
+  HazelcastCacheAdmin(HazelcastHttpCache& cache);
+
+  // Registers the handlers above to the given admin.
+  void registerHandlers(Server::Admin& admin);
+
+  Http::Code handlerStatus(absl::string_view path_and_query,
+      Http::HeaderMap& response_headers, Buffer::Instance& response,
+      Server::AdminStream& admin_stream);
+
+  Http::Code handlerInspect(absl::string_view path_and_query,
+      Http::HeaderMap& response_headers, Buffer::Instance& response,
+      Server::AdminStream& admin_stream);
+
+  static const std::string STATUS_PREFIX;
+  static const std::string INSPECT_PREFIX;
+
+private:
+  HazelcastHttpCache& hz_cache_;
+};
+
+using HazelcastCacheAdminPtr = std::unique_ptr<HazelcastCacheAdmin>;
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -3,17 +3,256 @@
 //
 #include "hazelcast_cache_entry.h"
 
+#include "absl/container/fixed_array.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace Cache {
 
+namespace {
+
+// Big endian encoding of the section payloads.
+class SectionWriter {
+public:
+  void writeByte(hazelcast::byte value) { bytes_.push_back(value); }
+
+  void writeLong(uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      bytes_.push_back(static_cast<hazelcast::byte>(value >> shift));
+    }
+  }
+
+  void writeString(const std::string& value) {
+    writeLong(value.size());
+    bytes_.insert(bytes_.end(), value.begin(), value.end());
+  }
+
+  const std::vector<hazelcast::byte>* bytes() const { return &bytes_; }
+
+private:
+  std::vector<hazelcast::byte> bytes_;
+};
+
+// Reads a section payload written by SectionWriter. Reads past the
+// end fail instead of throwing, so that a malformed section makes the
+// entry unsupported.
+class SectionReader {
+public:
+  SectionReader(const std::vector<hazelcast::byte>& bytes) : bytes_(bytes) {}
+
+  bool readByte(hazelcast::byte& value) {
+    if (position_ + 1 > bytes_.size()) return false;
+    value = bytes_[position_++];
+    return true;
+  }
+
+  bool readLong(uint64_t& value) {
+    if (position_ + 8 > bytes_.size()) return false;
+    value = 0;
+    for (int i = 0; i < 8; i++) {
+      value = (value << 8) | bytes_[position_++];
+    }
+    return true;
+  }
+
+  bool readString(std::string& value) {
+    uint64_t size;
+    if (!readLong(size) || size > bytes_.size() - position_) return false;
+    value.assign(bytes_.begin() + position_, bytes_.begin() + position_ + size);
+    position_ += size;
+    return true;
+  }
+
+private:
+  const std::vector<hazelcast::byte>& bytes_;
+  size_t position_ = 0;
+};
+
+void appendLength(std::vector<hazelcast::byte>& bytes, uint32_t length) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    bytes.push_back(static_cast<hazelcast::byte>(length >> shift));
+  }
+}
+
+void appendHeader(std::vector<hazelcast::byte>& bytes, absl::string_view key,
+    absl::string_view value) {
+  appendLength(bytes, key.size());
+  bytes.insert(bytes.end(), key.begin(), key.end());
+  appendLength(bytes, value.size());
+  bytes.insert(bytes.end(), value.begin(), value.end());
+}
+
+std::vector<hazelcast::byte> encodeHeaderMap(
+    const Http::HeaderMap& header_map) {
+  // Sized first, so that the bytes are not moved while appending.
+  size_t size = 0;
+  header_map.iterate(
+      [](const Http::HeaderEntry& header, void* context) ->
+      Http::HeaderMap::Iterate {
+        *static_cast<size_t*>(context) += 8 + header.key().size() +
+            header.value().size();
+        return Http::HeaderMap::Iterate::Continue;
+      },
+      &size);
+  std::vector<hazelcast::byte> bytes;
+  bytes.reserve(size);
+  header_map.iterate(
+      [](const Http::HeaderEntry& header, void* context) ->
+      Http::HeaderMap::Iterate {
+        appendHeader(*static_cast<std::vector<hazelcast::byte>*>(context),
+            header.key().getStringView(), header.value().getStringView());
+        return Http::HeaderMap::Iterate::Continue;
+      },
+      &bytes);
+  return bytes;
+}
+
+// Calls cb with each (key, value) of the encoded headers until it
+// returns false. Returns false if the encoding is malformed.
+template <typename Callback>
+bool forEachHeader(const std::vector<hazelcast::byte>& bytes, Callback cb) {
+  size_t position = 0;
+  auto next = [&bytes, &position](absl::string_view& field) {
+    if (bytes.size() - position < 4) return false;
+    uint32_t length = 0;
+    for (int i = 0; i < 4; i++) {
+      length = (length << 8) | bytes[position++];
+    }
+    if (bytes.size() - position < length) return false;
+    field = absl::string_view(
+        reinterpret_cast<const char*>(bytes.data()) + position, length);
+    position += length;
+    return true;
+  };
+  absl::string_view key, value;
+  while (position < bytes.size()) {
+    if (!next(key) || !next(value)) return false;
+    if (!cb(key, value)) break;
+  }
+  return true;
+}
+
+Http::HeaderMapImplPtr decodeHeaderMap(
+    const std::vector<hazelcast::byte>& bytes) {
+  auto header_map = std::make_unique<Http::HeaderMapImpl>();
+  forEachHeader(bytes, [&header_map](absl::string_view key,
+      absl::string_view value) {
+    Http::HeaderString key_string;
+    key_string.setCopy(key);
+    Http::HeaderString value_string;
+    value_string.setCopy(value);
+    header_map->addViaMove(std::move(key_string), std::move(value_string));
+    return true;
+  });
+  return header_map;
+}
+
+// Shared bytes are null if empty.
+const std::vector<hazelcast::byte>& bytesOf(const HazelcastBytesPtr& bytes) {
+  static const std::vector<hazelcast::byte> empty;
+  return bytes ? *bytes : empty;
+}
+
+HazelcastBytesPtr shareBytes(std::vector<hazelcast::byte>&& bytes) {
+  return bytes.empty() ? nullptr :
+      std::make_shared<const std::vector<hazelcast::byte>>(std::move(bytes));
+}
+
+// Headers of format version 1 and the legacy format.
+std::vector<hazelcast::byte> readHeaderArrays(ObjectDataInput& reader) {
+  std::vector<hazelcast::byte> bytes;
+  int headers_size = reader.readInt();
+  for (int i = 0; i < headers_size; i++) {
+    std::vector<char> key_vector = *reader.readCharArray();
+    std::vector<char> val_vector = *reader.readCharArray();
+    appendHeader(bytes, absl::string_view(key_vector.data(), key_vector.size()),
+        absl::string_view(val_vector.data(), val_vector.size()));
+  }
+  return bytes;
+}
+
+void writeHeaderArrays(ObjectDataOutput& writer,
+    const std::vector<hazelcast::byte>& bytes) {
+  int headers_size = 0;
+  forEachHeader(bytes, [&headers_size](absl::string_view, absl::string_view) {
+    headers_size++;
+    return true;
+  });
+  writer.writeInt(headers_size);
+  forEachHeader(bytes, [&writer](absl::string_view key,
+      absl::string_view value) {
+    std::vector<char> key_vector(key.begin(), key.end());
+    std::vector<char> val_vector(value.begin(), value.end());
+    writer.writeCharArray(&key_vector);
+    writer.writeCharArray(&val_vector);
+    return true;
+  });
+}
+
+}
+
 /// HazelcastHeaderHeaderEntry
 
 HazelcastHeaderEntry::HazelcastHeaderEntry() {};
 
+HazelcastHeaderEntry::HazelcastHeaderEntry(int class_id) :
+  legacy_format_(class_id == HAZELCAST_LEGACY_HEADER_TYPE_ID) {};
+
+void HazelcastHeaderEntry::setHeaders(const Http::HeaderMap& headers) {
+  header_map_.reset();
+  header_bytes_ = shareBytes(encodeHeaderMap(headers));
+}
+
+void HazelcastHeaderEntry::setHeaderMap(Http::HeaderMapImplPtr&& header_map) {
+  header_map_ = std::move(header_map);
+  header_bytes_.reset();
+}
+
+Http::HeaderMapImpl& HazelcastHeaderEntry::headerMap() {
+  if (!header_map_) {
+    header_map_ = decodeHeaderMap(bytesOf(header_bytes_));
+    // Copies of the entry may still share the bytes.
+    header_bytes_.reset();
+  }
+  return *header_map_;
+}
+
+Http::HeaderMapImplPtr HazelcastHeaderEntry::releaseHeaderMap() {
+  headerMap();
+  return std::move(header_map_);
+}
+
+void HazelcastHeaderEntry::setTrailers(const Http::HeaderMap& trailers) {
+  trailer_bytes_ = shareBytes(encodeHeaderMap(trailers));
+}
+
+Http::HeaderMapImplPtr HazelcastHeaderEntry::trailers() const {
+  return trailer_bytes_ ? decodeHeaderMap(*trailer_bytes_) : nullptr;
+}
+
+absl::optional<absl::string_view> HazelcastHeaderEntry::header(
+    absl::string_view name) const {
+  absl::optional<absl::string_view> found;
+  if (header_map_) {
+    const Http::HeaderEntry* entry =
+        header_map_->get(Http::LowerCaseString(std::string(name)));
+    if (entry) found = entry->value().getStringView();
+    return found;
+  }
+  forEachHeader(bytesOf(header_bytes_), [&name, &found](absl::string_view key,
+      absl::string_view value) {
+    if (key == name) {
+      found = value;
+      return false;
+    }
+    return true;
+  });
+  return found;
+}
+
 int HazelcastHeaderEntry::getClassId() const {
-  return TYPE_ID;
+  return legacy_format_ ? HAZELCAST_LEGACY_HEADER_TYPE_ID : TYPE_ID;
 }
 
 int HazelcastHeaderEntry::getFactoryId() const {
@@ -21,77 +260,352 @@ int HazelcastHeaderEntry::getFactoryId() const {
 }
 
 void HazelcastHeaderEntry::writeData(ObjectDataOutput &writer) const {
-  writer.writeInt(header_map_ptr->size());
-  header_map_ptr->iterate(
-      [](const Http::HeaderEntry& header, void* context) ->
-      Http::HeaderMap::Iterate {ObjectDataOutput* writer_ptr =
-            static_cast<ObjectDataOutput*>(context);
-        absl::string_view key_view = header.key().getStringView();
-        absl::string_view val_view = header.value().getStringView();
-        std::vector<char> key_vector(key_view.begin(),key_view.end());
-        std::vector<char> val_vector(val_view.begin(),val_view.end());
-        writer_ptr->writeCharArray(&key_vector);
-        writer_ptr->writeCharArray(&val_vector);
-        return Http::HeaderMap::Iterate::Continue;
-      },
-      &writer);
+  if (legacy_format_) {
+    writeHeaderArrays(writer, header_map_ ? encodeHeaderMap(*header_map_) :
+        bytesOf(header_bytes_));
+    writer.writeLong(total_body_size);
+    return;
+  }
+  int32_t features = 0;
+  if (body_codec != HazelcastBodyCodec::None) {
+    features |= HAZELCAST_FEATURE_COMPRESSED_BODY;
+  }
+  if (!partition_keys.empty()) {
+    features |= HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY;
+  }
+  if (!vary_spec.empty()) {
+    features |= HAZELCAST_FEATURE_VARY_SPEC;
+  }
+  if (trailer_bytes_) {
+    features |= HAZELCAST_FEATURE_TRAILERS;
+  }
+  writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION);
+  writer.writeInt(features);
+
+  if (header_map_) {
+    const std::vector<hazelcast::byte> header_bytes =
+        encodeHeaderMap(*header_map_);
+    writer.writeByteArray(&header_bytes);
+  } else {
+    writer.writeByteArray(&bytesOf(header_bytes_));
+  }
   writer.writeLong(total_body_size);
+  writer.writeLong(partition_schedule.firstSize());
+  writer.writeInt(partition_schedule.growthFactor());
+  writer.writeLong(partition_schedule.maxSize());
+
+  // A section for each feature, and the optional ones.
+  writer.writeInt(__builtin_popcount(features) + (freshness ? 1 : 0) +
+      (representations.empty() ? 0 : 1));
+  if (features & HAZELCAST_FEATURE_COMPRESSED_BODY) {
+    SectionWriter section;
+    section.writeByte(static_cast<hazelcast::byte>(body_codec));
+    section.writeLong(encoded_partition_sizes.size());
+    for (const uint64_t& size : encoded_partition_sizes) {
+      section.writeLong(size);
+    }
+    writer.writeByte(HAZELCAST_SECTION_BODY_CODEC);
+    writer.writeByteArray(section.bytes());
+  }
+  if (features & HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY) {
+    SectionWriter section;
+    section.writeLong(partition_keys.size());
+    for (const std::string& key : partition_keys) {
+      section.writeString(key);
+    }
+    writer.writeByte(HAZELCAST_SECTION_PARTITION_KEYS);
+    writer.writeByteArray(section.bytes());
+  }
+  if (freshness) {
+    SectionWriter section;
+    section.writeLong(freshness->response_time);
+    section.writeLong(freshness->freshness_lifetime);
+    section.writeString(freshness->etag);
+    section.writeString(freshness->last_modified);
+    section.writeLong(freshness->vary.size());
+    for (const std::string& name : freshness->vary) {
+      section.writeString(name);
+    }
+    writer.writeByte(HAZELCAST_SECTION_FRESHNESS);
+    writer.writeByteArray(section.bytes());
+  }
+  if (features & HAZELCAST_FEATURE_VARY_SPEC) {
+    SectionWriter section;
+    section.writeLong(vary_spec.size());
+    for (const std::string& name : vary_spec) {
+      section.writeString(name);
+    }
+    writer.writeByte(HAZELCAST_SECTION_VARY_SPEC);
+    writer.writeByteArray(section.bytes());
+  }
+  if (!representations.empty()) {
+    SectionWriter section;
+    section.writeLong(representations.size());
+    for (const HazelcastRepresentation& representation : representations) {
+      section.writeByte(static_cast<hazelcast::byte>(representation.codec));
+      section.writeLong(representation.partition_sizes.size());
+      for (const uint64_t& size : representation.partition_sizes) {
+        section.writeLong(size);
+      }
+      section.writeLong(representation.partition_keys.size());
+      for (const std::string& key : representation.partition_keys) {
+        section.writeString(key);
+      }
+    }
+    writer.writeByte(HAZELCAST_SECTION_REPRESENTATIONS);
+    writer.writeByteArray(section.bytes());
+  }
+  if (features & HAZELCAST_FEATURE_TRAILERS) {
+    // Encoded as the headers.
+    writer.writeByte(HAZELCAST_SECTION_TRAILERS);
+    writer.writeByteArray(trailer_bytes_.get());
+  }
 }
 
 void HazelcastHeaderEntry::readData(ObjectDataInput &reader) {
-  header_map_ptr = std::make_unique<Http::HeaderMapImpl>();
-  int headers_size = reader.readInt();
-  for (int i = 0; i < headers_size; i++) {
-    std::vector<char> key_vector = *reader.readCharArray();
-    std::vector<char> val_vector = *reader.readCharArray();
-    Http::HeaderString key,val;
-    key.append(key_vector.data(),key_vector.size());
-    val.append(val_vector.data(),val_vector.size());
-    header_map_ptr->addViaMove(std::move(key),std::move(val));
+  body_codec = HazelcastBodyCodec::None;
+  encoded_partition_sizes.clear();
+  partition_keys.clear();
+  freshness.reset();
+  vary_spec.clear();
+  representations.clear();
+  header_map_.reset();
+  header_bytes_.reset();
+  trailer_bytes_.reset();
+  if (legacy_format_) {
+    header_bytes_ = shareBytes(readHeaderArrays(reader));
+    total_body_size = reader.readLong();
+    return;
+  }
+
+  const hazelcast::byte version = reader.readByte();
+  const int32_t features = reader.readInt();
+  if (version > HAZELCAST_ENTRY_FORMAT_VERSION ||
+      (features & ~HAZELCAST_KNOWN_FEATURES)) {
+    // Written by a newer version. The rest is not read.
+    total_body_size = 0;
+    supported_ = false;
+    return;
+  }
+
+  if (version == 1) {
+    header_bytes_ = shareBytes(readHeaderArrays(reader));
+  } else {
+    // Taken from the array read instead of copied.
+    header_bytes_ = HazelcastBytesPtr(reader.readByteArray().release());
+    // Fail on read rather than serving partial headers.
+    supported_ = forEachHeader(bytesOf(header_bytes_),
+        [](absl::string_view, absl::string_view) { return true; });
   }
   total_body_size = reader.readLong();
+  const uint64_t first_size = reader.readLong();
+  const uint32_t growth_factor = reader.readInt();
+  const uint64_t max_size = reader.readLong();
+  if (!HazelcastPartitionSchedule::valid(first_size, growth_factor,
+      max_size)) {
+    supported_ = false;
+    return;
+  }
+  partition_schedule = HazelcastPartitionSchedule(first_size, growth_factor,
+      max_size);
+
+  const int section_count = reader.readInt();
+  for (int i = 0; i < section_count; i++) {
+    const hazelcast::byte section_id = reader.readByte();
+    const std::vector<hazelcast::byte> payload = *reader.readByteArray();
+    SectionReader section(payload);
+    uint64_t count;
+    switch (section_id) {
+    case HAZELCAST_SECTION_BODY_CODEC: {
+      hazelcast::byte codec = 0;
+      supported_ &= section.readByte(codec) && section.readLong(count);
+      body_codec = static_cast<HazelcastBodyCodec>(codec);
+      uint64_t size;
+      for (uint64_t j = 0; supported_ && j < count; j++) {
+        supported_ = section.readLong(size);
+        encoded_partition_sizes.push_back(size);
+      }
+      break;
+    }
+    case HAZELCAST_SECTION_PARTITION_KEYS: {
+      supported_ &= section.readLong(count);
+      std::string key;
+      for (uint64_t j = 0; supported_ && j < count; j++) {
+        supported_ = section.readString(key);
+        partition_keys.push_back(key);
+      }
+      break;
+    }
+    case HAZELCAST_SECTION_FRESHNESS: {
+      HazelcastFreshness read;
+      uint64_t response_time, freshness_lifetime;
+      supported_ &= section.readLong(response_time) &&
+          section.readLong(freshness_lifetime) &&
+          section.readString(read.etag) &&
+          section.readString(read.last_modified) && section.readLong(count);
+      read.response_time = response_time;
+      read.freshness_lifetime = freshness_lifetime;
+      std::string name;
+      for (uint64_t j = 0; supported_ && j < count; j++) {
+        supported_ = section.readString(name);
+        read.vary.push_back(name);
+      }
+      freshness = std::move(read);
+      break;
+    }
+    case HAZELCAST_SECTION_REPRESENTATIONS: {
+      supported_ &= section.readLong(count);
+      for (uint64_t j = 0; supported_ && j < count; j++) {
+        HazelcastRepresentation representation;
+        hazelcast::byte codec = 0;
+        uint64_t size_count, key_count, size;
+        std::string key;
+        supported_ = section.readByte(codec) && section.readLong(size_count);
+        for (uint64_t k = 0; supported_ && k < size_count; k++) {
+          supported_ = section.readLong(size);
+          representation.partition_sizes.push_back(size);
+        }
+        supported_ &= section.readLong(key_count);
+        for (uint64_t k = 0; supported_ && k < key_count; k++) {
+          supported_ = section.readString(key);
+          representation.partition_keys.push_back(key);
+        }
+        representation.codec = static_cast<HazelcastBodyCodec>(codec);
+        representations.push_back(std::move(representation));
+      }
+      break;
+    }
+    case HAZELCAST_SECTION_VARY_SPEC: {
+      supported_ &= section.readLong(count);
+      std::string name;
+      for (uint64_t j = 0; supported_ && j < count; j++) {
+        supported_ = section.readString(name);
+        vary_spec.push_back(name);
+      }
+      break;
+    }
+    case HAZELCAST_SECTION_TRAILERS: {
+      supported_ &= forEachHeader(payload,
+          [](absl::string_view, absl::string_view) { return true; });
+      trailer_bytes_ = shareBytes(std::vector<hazelcast::byte>(payload));
+      break;
+    }
+    default:
+      // Optional section of a newer version.
+      break;
+    }
+  }
+
+  // Data of the required features has to be present.
+  if (((features & HAZELCAST_FEATURE_COMPRESSED_BODY) &&
+      body_codec == HazelcastBodyCodec::None) ||
+      ((features & HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY) &&
+      partition_keys.empty()) ||
+      ((features & HAZELCAST_FEATURE_VARY_SPEC) && vary_spec.empty()) ||
+      ((features & HAZELCAST_FEATURE_TRAILERS) && !trailer_bytes_)) {
+    supported_ = false;
+  }
 }
 
 // Hazelcast needs copy constructor in case of Near Cache usage.
 HazelcastHeaderEntry::HazelcastHeaderEntry(const HazelcastHeaderEntry &other) {
   this->total_body_size = other.total_body_size;
-  other.header_map_ptr->iterate(
-      [](const Http::HeaderEntry& header, void* context) ->
-      Http::HeaderMap::Iterate {
-        Http::HeaderString key_string;
-        key_string.setCopy(header.key().getStringView());
-        Http::HeaderString value_string;
-        value_string.setCopy(header.value().getStringView());
-        static_cast<HazelcastHeaderEntry*>(context)->header_map_ptr->
-          addViaMove(std::move(key_string), std::move(value_string));
-        return Http::HeaderMap::Iterate::Continue;
-      },
-      this);
+  this->partition_schedule = other.partition_schedule;
+  this->body_codec = other.body_codec;
+  this->encoded_partition_sizes = other.encoded_partition_sizes;
+  this->partition_keys = other.partition_keys;
+  this->freshness = other.freshness;
+  this->vary_spec = other.vary_spec;
+  this->representations = other.representations;
+  this->supported_ = other.supported_;
+  this->legacy_format_ = other.legacy_format_;
+  // The copy keeps the headers serialized, sharing the bytes of the
+  // other entry unless its map is built.
+  this->header_bytes_ = other.header_map_ ?
+      shareBytes(encodeHeaderMap(*other.header_map_)) : other.header_bytes_;
+  this->trailer_bytes_ = other.trailer_bytes_;
 }
 
 /// HazelcastBodyEntry
 
 HazelcastBodyEntry::HazelcastBodyEntry() {};
 
+HazelcastBodyEntry::HazelcastBodyEntry(int class_id) :
+  legacy_format_(class_id == HAZELCAST_LEGACY_BODY_TYPE_ID) {};
+
 // Hazelcast needs copy constructor in case of Near Cache usage.
 HazelcastBodyEntry::HazelcastBodyEntry(const HazelcastBodyEntry &other) {
   this->body_buffer_ = other.body_buffer_;
+  this->body_slices_.add(other.body_slices_);
+  this->supported_ = other.supported_;
+  this->legacy_format_ = other.legacy_format_;
 };
 
+HazelcastBodyEntry::HazelcastBodyEntry(HazelcastBodyEntry&& other) noexcept :
+  body_buffer_(std::move(other.body_buffer_)),
+  supported_(other.supported_),
+  legacy_format_(other.legacy_format_) {
+  body_slices_.move(other.body_slices_);
+}
+
+void HazelcastBodyEntry::setBody(Buffer::Instance& body) {
+  body_buffer_.clear();
+  body_slices_.drain(body_slices_.length());
+  body_slices_.move(body);
+}
+
 int HazelcastBodyEntry::getFactoryId() const {
   return HAZELCAST_ENTRY_SERIALIZER_FACTORY_ID;
 };
 
 int HazelcastBodyEntry::getClassId() const {
-  return TYPE_ID;
+  return legacy_format_ ? HAZELCAST_LEGACY_BODY_TYPE_ID : TYPE_ID;
 };
 
 void HazelcastBodyEntry::writeData(ObjectDataOutput &writer) const {
-  writer.writeByteArray(&body_buffer_);
+  // The legacy format is the content only.
+  if (!legacy_format_) {
+    writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION);
+    writer.writeInt(0); // no features yet
+  }
+  if (body_slices_.length() > 0) {
+    // Same encoding as writeByteArray.
+    writer.writeInt(body_slices_.length());
+    const uint64_t num_slices = body_slices_.getRawSlices(nullptr, 0);
+    absl::FixedArray<Buffer::RawSlice> slices(num_slices);
+    body_slices_.getRawSlices(slices.begin(), num_slices);
+    for (const Buffer::RawSlice& slice : slices) {
+      writer.writeBytes(static_cast<const hazelcast::byte*>(slice.mem_),
+          slice.len_);
+    }
+  } else {
+    writer.writeByteArray(&body_buffer_);
+  }
+  if (!legacy_format_) {
+    writer.writeInt(0); // no sections yet
+  }
 }
 
 void HazelcastBodyEntry::readData(ObjectDataInput &reader) {
-  body_buffer_ = *reader.readByteArray();
+  // Taken from the array read instead of copied.
+  if (legacy_format_) {
+    body_buffer_.swap(*reader.readByteArray());
+    return;
+  }
+  const hazelcast::byte version = reader.readByte();
+  const int32_t features = reader.readInt();
+  if (version > HAZELCAST_ENTRY_FORMAT_VERSION || features != 0) {
+    // Written by a newer version. The rest is not read.
+    supported_ = false;
+    return;
+  }
+  body_buffer_.swap(*reader.readByteArray());
+  const int section_count = reader.readInt();
+  for (int i = 0; i < section_count; i++) {
+    // Optional sections of a newer version.
+    reader.readByte();
+    reader.readByteArray();
+  }
 }
 
 } // Cache
@@ -8,22 +8,134 @@
 #include "hazelcast/client/serialization/IdentifiedDataSerializable.h"
 #include "hazelcast/client/serialization/ObjectDataInput.h"
 #include "hazelcast/client/serialization/ObjectDataOutput.h"
+#include "hazelcast_partition_schedule.h"
+#include "absl/types/optional.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace Cache {
 
-static const int HAZELCAST_BODY_TYPE_ID = 100;
-static const int HAZELCAST_HEADER_TYPE_ID = 101;
+// Immutable serialized bytes, shared between copies of an entry.
+using HazelcastBytesPtr = std::shared_ptr<const std::vector<hazelcast::byte>>;
+
+// Entries of the initial, unversioned format. Read, and written only
+// with legacy_entry_format during an upgrade (see below).
+static const int HAZELCAST_LEGACY_BODY_TYPE_ID = 100;
+static const int HAZELCAST_LEGACY_HEADER_TYPE_ID = 101;
+// Entries of the versioned format below.
+static const int HAZELCAST_BODY_TYPE_ID = 102;
+static const int HAZELCAST_HEADER_TYPE_ID = 103;
 static const int HAZELCAST_ENTRY_SERIALIZER_FACTORY_ID = 1000;
 
+/**
+ * Wire format of the entries.
+ *
+ * Both entry types start with a format version byte and a set of
+ * feature flags, followed by the fields of the entry type and a list
+ * of optional sections:
+ *
+ *   byte      format version
+ *   int       feature flags
+ *   ...       fields of the format version
+ *   int       number of sections
+ *   (byte, byte[]) section id and payload, for each section
+ *
+ * Rules for rolling upgrades, where writers and readers of different
+ * versions share the same cluster:
+ *
+ *  - Additional data which readers may ignore goes to a new section.
+ *    Readers skip sections with unknown ids.
+ *  - A feature changing how the body has to be read (e.g. compression)
+ *    sets a flag. Readers not knowing a flag treat the entry as a miss
+ *    instead of serving a wrong response.
+ *  - The version is increased only if the fields before the sections
+ *    change. Readers treat entries of newer versions as a miss.
+ *
+ * Entries written before versioning have their own class ids, hence
+ * are still read. Readers before versioning do not know the ids of
+ * the versioned entries: their factory returns null for them, which
+ * the client dereferences, so they crash instead of treating them as
+ * a miss. Hence an upgrade from those readers takes two steps: first
+ * all Envoys are upgraded with legacy_entry_format set, writing the
+ * unversioned format which both versions read (see
+ * setLegacyFormat), then the flag is unset.
+ */
+static const hazelcast::byte HAZELCAST_ENTRY_FORMAT_VERSION = 2;
+
+// Versions of the header entry fields:
+//   1: headers as (key, value) char arrays
+//   2: headers as a single byte array, see HazelcastHeaderEntry
+
+// Feature flags of the header entry.
+static const int32_t HAZELCAST_FEATURE_COMPRESSED_BODY = 1 << 0;
+static const int32_t HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY = 1 << 1;
+static const int32_t HAZELCAST_FEATURE_VARY_SPEC = 1 << 2;
+// Readers not knowing trailers would serve the response without them.
+static const int32_t HAZELCAST_FEATURE_TRAILERS = 1 << 3;
+static const int32_t HAZELCAST_KNOWN_FEATURES =
+    HAZELCAST_FEATURE_COMPRESSED_BODY |
+    HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY |
+    HAZELCAST_FEATURE_VARY_SPEC |
+    HAZELCAST_FEATURE_TRAILERS;
+
+// Section ids of the header entry.
+static const hazelcast::byte HAZELCAST_SECTION_BODY_CODEC = 1;
+static const hazelcast::byte HAZELCAST_SECTION_PARTITION_KEYS = 2;
+static const hazelcast::byte HAZELCAST_SECTION_FRESHNESS = 3;
+static const hazelcast::byte HAZELCAST_SECTION_VARY_SPEC = 4;
+static const hazelcast::byte HAZELCAST_SECTION_REPRESENTATIONS = 5;
+static const hazelcast::byte HAZELCAST_SECTION_TRAILERS = 6;
+
 using BufferImplPtr = std::unique_ptr<Buffer::OwnedImpl>;
 using hazelcast::client::serialization::IdentifiedDataSerializable;
 using hazelcast::client::serialization::ObjectDataOutput;
 using hazelcast::client::serialization::ObjectDataInput;
 using hazelcast::client::serialization::DataSerializableFactory;
 
+/**
+ * Encoding of the stored body partitions of a response.
+ * See hazelcast_body_codec.h
+ */
+enum class HazelcastBodyCodec : hazelcast::byte {
+  None = 0,
+  Gzip = 1
+};
+
+/**
+ * Freshness related fields of a response, computed once on insert.
+ * A lookup decides whether the entry is fresh from these without
+ * parsing the stored headers.
+ */
+struct HazelcastFreshness {
+  // Date of the response, in seconds since epoch. Zero if missing.
+  int64_t response_time = 0;
+
+  // Seconds the response stays fresh after response_time. Negative
+  // if the response always requires validation.
+  int64_t freshness_lifetime = -1;
+
+  // Validators, empty if missing.
+  std::string etag;
+  std::string last_modified;
+
+  // Lower case names of the request headers listed in Vary.
+  std::vector<std::string> vary;
+};
+
+/**
+ * Additional encoding of a response body, stored besides the body
+ * partitions of the header entry. Lookups pick the one the request
+ * accepts instead of converting the body on each hit.
+ */
+struct HazelcastRepresentation {
+  HazelcastBodyCodec codec = HazelcastBodyCodec::None;
+  // Stored size of each partition in order.
+  std::vector<uint64_t> partition_sizes;
+  // Keys of the partitions if deduplicated, empty otherwise.
+  std::vector<std::string> partition_keys;
+};
+
 /**
  *  Structure for cached response headers.
  *
@@ -42,24 +154,112 @@ using hazelcast::client::serialization::DataSerializableFactory;
  *  +--------------+       | Response headers |
  *  | 64 bit hash  +-----> +                  |
  *  +--------------+       | Total Body Size  |
- *         KEY             +------------------+
+ *         KEY             | Body codec       |
+ *                         +------------------+
  *                                 VALUE
+ *
+ *  If the body is compressed, sizes of the compressed partitions
+ *  are kept as well, to serve the encoded body as is. If bodies are
+ *  deduplicated, keys of the body partitions are kept too. Freshness
+ *  fields and trailers of the response are kept in separate sections.
+ *
+ *  Responses with Vary are stored in two steps: a small Vary spec
+ *  entry under the hash key, listing the varied request headers,
+ *  and the variants under hash keys of the request header values.
  */
 class HazelcastHeaderEntry : public IdentifiedDataSerializable {
 public:
   static const int TYPE_ID = HAZELCAST_HEADER_TYPE_ID;
-  Http::HeaderMapImplPtr header_map_ptr;
   uint64_t total_body_size;
 
+  // Sizes of the body partitions, as configured on insert.
+  HazelcastPartitionSchedule partition_schedule;
+
+  // Codec of the body partitions and, unless None, the encoded
+  // size of each partition in order.
+  HazelcastBodyCodec body_codec = HazelcastBodyCodec::None;
+  std::vector<uint64_t> encoded_partition_sizes;
+
+  // Keys of the body partitions in order if they are stored content
+  // addressed (deduplicated). Empty if the keys are derived from the
+  // hash key.
+  std::vector<std::string> partition_keys;
+
+  // Precomputed freshness of the response. Missing for entries written
+  // before it was introduced.
+  absl::optional<HazelcastFreshness> freshness;
+
+  // If not empty, the entry is a Vary spec instead of a response: the
+  // response varies on these request headers (lower case) and each
+  // variant is stored under the key of its values (see
+  // HazelcastHttpCache). A spec has no headers and no body.
+  std::vector<std::string> vary_spec;
+
+  // Other encodings of the body. Readers not knowing them use the
+  // body partitions above.
+  std::vector<HazelcastRepresentation> representations;
+
   HazelcastHeaderEntry();
+  // Copies share the serialized headers and trailers, which are never
+  // modified in place, hence copying an entry read from the cache does
+  // not copy its header bytes.
   HazelcastHeaderEntry(const HazelcastHeaderEntry &other);
 
+  // Creates an entry reading the given class id (see above).
+  explicit HazelcastHeaderEntry(int class_id);
+
+  // False if the entry was written by a newer, incompatible version.
+  // Such entries are treated as a miss.
+  bool supported() const { return supported_; }
+
+  // True if the entry was written before versioning. These entries
+  // do not have a partition schedule.
+  bool legacyFormat() const { return legacy_format_; }
+  // Writes the entry in the format before versioning: headers and the
+  // total body size only. Other fields are not written.
+  void setLegacyFormat(bool legacy) { legacy_format_ = legacy; }
+
+  // Response headers. A read entry keeps them serialized until the
+  // header map is asked for, hence a lookup that finds the entry stale
+  // does not build the map.
+  void setHeaderMap(Http::HeaderMapImplPtr&& header_map);
+  // Serializes the headers right away instead of keeping a copy of
+  // the map until the entry is written.
+  void setHeaders(const Http::HeaderMap& headers);
+  Http::HeaderMapImpl& headerMap();
+  // Moves the header map out of the entry.
+  Http::HeaderMapImplPtr releaseHeaderMap();
+
+  // Value of a single header, read from the serialized headers unless
+  // the map is built. The name has to be lower case.
+  absl::optional<absl::string_view> header(absl::string_view name) const;
+
+  // Response trailers, kept serialized as the headers. Entries with
+  // trailers set a feature flag, so readers not knowing them treat
+  // the entry as a miss. trailers() returns nullptr if the response
+  // has none.
+  void setTrailers(const Http::HeaderMap& trailers);
+  Http::HeaderMapImplPtr trailers() const;
+  bool hasTrailers() const { return trailer_bytes_ != nullptr; }
+
   // serialization::IdentifiedDataSerializable
   int getFactoryId() const;
   int getClassId() const;
   void writeData(ObjectDataOutput &writer) const;
   void readData(ObjectDataInput &reader);
 
+private:
+  bool supported_ = true;
+  bool legacy_format_ = false;
+
+  // Either may be set. The map is serialized on write if set.
+  Http::HeaderMapImplPtr header_map_;
+  // Headers as they are serialized: for each header, the key and the
+  // value, each prefixed by its length in 4 bytes big endian. Null if
+  // empty. Replaced as a whole, shared with copies of the entry.
+  HazelcastBytesPtr header_bytes_;
+  HazelcastBytesPtr trailer_bytes_;
+
 };
 
 /**
@@ -84,6 +284,11 @@ public:
  *
  * 64 bit hash keys here come from the same origin as in header map.
  *
+ * When deduplication is enabled, partitions are keyed by the SHA-256
+ * digest of their content instead, and the keys are listed in the
+ * header entry. Identical partitions of different responses are then
+ * stored once.
+ *
  * This operation comes with the cost of increased entry sizes (fixed
  * cost for map entries). However, upon a ranged request it makes
  * cache response faster. This trade off is up to user.
@@ -92,6 +297,11 @@ public:
  * number, the cache will operate as it stores bodies without
  * partitioning.
  *
+ * Partitions can also grow geometrically instead of having a fixed
+ * size (see hazelcast_partition_schedule.h). Then the first bytes
+ * are served from a small entry while large bodies still consist of
+ * a few entries.
+ *
  */
 
 // TODO: Implement Hazelcast::PartitionAware for body entries.
@@ -101,10 +311,34 @@ class HazelcastBodyEntry : public IdentifiedDataSerializable {
 public:
   static const int TYPE_ID = HAZELCAST_BODY_TYPE_ID;
 
+  // Content of a read entry, or of an entry to be written unless
+  // setBody is used.
   std::vector<hazelcast::byte> body_buffer_;
 
   HazelcastBodyEntry();
   HazelcastBodyEntry(const HazelcastBodyEntry &other);
+  // Takes the content of the other entry without copying it, e.g. to
+  // queue an entry for a later write.
+  HazelcastBodyEntry(HazelcastBodyEntry&& other) noexcept;
+
+  // Creates an entry reading the given class id (see above).
+  explicit HazelcastBodyEntry(int class_id);
+
+  // Moves the slices of the buffer into the entry. They are serialized
+  // as they are, without copying them into body_buffer_ first.
+  void setBody(Buffer::Instance& body);
+
+  // Number of content bytes, either set or read.
+  uint64_t size() const {
+    return body_buffer_.size() + body_slices_.length();
+  }
+
+  // False if the entry was written by a newer, incompatible version.
+  bool supported() const { return supported_; }
+
+  // Writes the entry in the format before versioning, see
+  // HazelcastHeaderEntry::setLegacyFormat.
+  void setLegacyFormat(bool legacy) { legacy_format_ = legacy; }
 
   // serialization::IdentifiedDataSerializable
   int getFactoryId() const;
@@ -112,6 +346,12 @@ public:
   void writeData(ObjectDataOutput& writer) const;
   void readData(ObjectDataInput &reader);
 
+private:
+  bool supported_ = true;
+  bool legacy_format_ = false;
+
+  Buffer::OwnedImpl body_slices_;
+
 };
 
 // To make cache compatible with Hazelcast Cpp Client,
@@ -134,11 +374,13 @@ public:
   virtual std::auto_ptr<IdentifiedDataSerializable> create(int32_t classId) {
     switch (classId) {
     case HAZELCAST_BODY_TYPE_ID:
+    case HAZELCAST_LEGACY_BODY_TYPE_ID:
       return std::auto_ptr<IdentifiedDataSerializable>
-          (new HazelcastBodyEntry());
+          (new HazelcastBodyEntry(classId));
     case HAZELCAST_HEADER_TYPE_ID:
+    case HAZELCAST_LEGACY_HEADER_TYPE_ID:
       return std::auto_ptr<IdentifiedDataSerializable>
-          (new HazelcastHeaderEntry());
+          (new HazelcastHeaderEntry(classId));
     default:
       return std::auto_ptr<IdentifiedDataSerializable>();
     }
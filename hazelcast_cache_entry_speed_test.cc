@@ -0,0 +1,241 @@
+// Note: this should be run with --compilation_mode=opt, and would benefit from
+// a quiescent system with disabled cstate power management.
+//
+// Measures serialization, deserialization and copy (near cache) costs of the
+// cache entries. Besides time per operation, following counters are reported:
+//   bytes/op  : serialized size of the entry.
+//   allocs/op : heap allocations per operation, if built with tcmalloc.
+
+#include "hazelcast/client/SerializationConfig.h"
+#include "hazelcast/client/serialization/pimpl/SerializationService.h"
+#include "hazelcast_allocation_counter.h"
+#include "hazelcast_cache_entry.h"
+
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+using hazelcast::client::serialization::pimpl::Data;
+using hazelcast::client::serialization::pimpl::SerializationService;
+
+SerializationService& serializationService() {
+  static hazelcast::client::SerializationConfig* config = [] {
+    auto* config = new hazelcast::client::SerializationConfig();
+    config->addDataSerializableFactory(
+        HazelcastCacheEntrySerializableFactory::FACTORY_ID,
+        boost::shared_ptr<
+            hazelcast::client::serialization::DataSerializableFactory>(
+            new HazelcastCacheEntrySerializableFactory()));
+    return config;
+  }();
+  static SerializationService* service = new SerializationService(*config);
+  return *service;
+}
+
+// Response headers of a typical cacheable response, padded with
+// custom headers up to header_count.
+Http::HeaderMapImplPtr makeHeaderMap(int header_count) {
+  auto header_map = std::make_unique<Http::HeaderMapImpl>();
+  const std::vector<std::pair<std::string, std::string>> common_headers{
+      {":status", "200"},
+      {"date", "Mon, 19 Oct 2026 10:00:00 GMT"},
+      {"cache-control", "public, max-age=3600"},
+      {"content-type", "application/json; charset=utf-8"},
+      {"etag", "\"5d8c72a5edda8d6a:3239\""},
+      {"last-modified", "Sun, 18 Oct 2026 08:30:00 GMT"},
+      {"vary", "Accept-Encoding"},
+      {"server", "envoy"}};
+  for (int i = 0; i < header_count; i++) {
+    Http::HeaderString key;
+    Http::HeaderString value;
+    if (i < static_cast<int>(common_headers.size())) {
+      key.setCopy(common_headers[i].first);
+      value.setCopy(common_headers[i].second);
+    } else {
+      key.setCopy("x-custom-header-" + std::to_string(i));
+      value.setCopy(std::string(32, 'v'));
+    }
+    header_map->addViaMove(std::move(key), std::move(value));
+  }
+  return header_map;
+}
+
+HazelcastHeaderEntry makeHeaderEntry(int header_count) {
+  HazelcastHeaderEntry entry;
+  entry.setHeaderMap(makeHeaderMap(header_count));
+  entry.total_body_size = 4096;
+  return entry;
+}
+
+HazelcastBodyEntry makeBodyEntry(size_t body_size) {
+  HazelcastBodyEntry entry;
+  entry.body_buffer_.resize(body_size, 'b');
+  return entry;
+}
+
+void reportCounters(benchmark::State& state, size_t bytes,
+    uint64_t allocations) {
+  state.counters["bytes/op"] = bytes;
+  if (AllocationCounter::supported()) {
+    state.counters["allocs/op"] = benchmark::Counter(allocations,
+        benchmark::Counter::kAvgIterations);
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// SerializationService::toObject returns std::auto_ptr.
+// Hence the warnings are suppressed here.
+
+void BM_HeaderEntryWrite(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const HazelcastHeaderEntry entry = makeHeaderEntry(state.range(0));
+  size_t bytes = 0;
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    Data data = service.toData<HazelcastHeaderEntry>(&entry);
+    allocations += counter.allocations();
+    bytes = data.totalSize();
+    benchmark::DoNotOptimize(data);
+  }
+  reportCounters(state, bytes, allocations);
+}
+BENCHMARK(BM_HeaderEntryWrite)->Arg(10)->Arg(20)->Arg(40)->Arg(80);
+
+// Headers of a response encoded and written, as on insert.
+void BM_HeaderEntryInsert(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const Http::HeaderMapImplPtr header_map = makeHeaderMap(state.range(0));
+  size_t bytes = 0;
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    HazelcastHeaderEntry entry;
+    entry.setHeaders(*header_map);
+    entry.total_body_size = 4096;
+    Data data = service.toData<HazelcastHeaderEntry>(&entry);
+    allocations += counter.allocations();
+    bytes = data.totalSize();
+    benchmark::DoNotOptimize(data);
+  }
+  reportCounters(state, bytes, allocations);
+}
+BENCHMARK(BM_HeaderEntryInsert)->Arg(10)->Arg(20)->Arg(40)->Arg(80);
+
+void BM_HeaderEntryRead(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const HazelcastHeaderEntry entry = makeHeaderEntry(state.range(0));
+  const Data data = service.toData<HazelcastHeaderEntry>(&entry);
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    std::auto_ptr<HazelcastHeaderEntry> read =
+        service.toObject<HazelcastHeaderEntry>(data);
+    allocations += counter.allocations();
+    benchmark::DoNotOptimize(read);
+  }
+  reportCounters(state, data.totalSize(), allocations);
+}
+BENCHMARK(BM_HeaderEntryRead)->Arg(10)->Arg(20)->Arg(40)->Arg(80);
+
+// Read followed by building the header map, as on a fresh hit.
+void BM_HeaderEntryReadHeaderMap(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const HazelcastHeaderEntry entry = makeHeaderEntry(state.range(0));
+  const Data data = service.toData<HazelcastHeaderEntry>(&entry);
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    std::auto_ptr<HazelcastHeaderEntry> read =
+        service.toObject<HazelcastHeaderEntry>(data);
+    Http::HeaderMapImplPtr header_map = read->releaseHeaderMap();
+    allocations += counter.allocations();
+    benchmark::DoNotOptimize(header_map);
+  }
+  reportCounters(state, data.totalSize(), allocations);
+}
+BENCHMARK(BM_HeaderEntryReadHeaderMap)->Arg(10)->Arg(20)->Arg(40)->Arg(80);
+
+void BM_HeaderEntryCopy(benchmark::State& state) {
+  const HazelcastHeaderEntry entry = makeHeaderEntry(state.range(0));
+  const size_t bytes = serializationService().toData<HazelcastHeaderEntry>
+      (&entry).totalSize();
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    HazelcastHeaderEntry copy(entry);
+    allocations += counter.allocations();
+    benchmark::DoNotOptimize(copy);
+  }
+  reportCounters(state, bytes, allocations);
+}
+BENCHMARK(BM_HeaderEntryCopy)->Arg(10)->Arg(20)->Arg(40)->Arg(80);
+
+void BM_BodyEntryWrite(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const HazelcastBodyEntry entry = makeBodyEntry(state.range(0));
+  size_t bytes = 0;
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    Data data = service.toData<HazelcastBodyEntry>(&entry);
+    allocations += counter.allocations();
+    bytes = data.totalSize();
+    benchmark::DoNotOptimize(data);
+  }
+  reportCounters(state, bytes, allocations);
+}
+BENCHMARK(BM_BodyEntryWrite)->RangeMultiplier(4)->Range(1 << 10, 4 << 20);
+
+void BM_BodyEntryRead(benchmark::State& state) {
+  SerializationService& service = serializationService();
+  const HazelcastBodyEntry entry = makeBodyEntry(state.range(0));
+  const Data data = service.toData<HazelcastBodyEntry>(&entry);
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    std::auto_ptr<HazelcastBodyEntry> read =
+        service.toObject<HazelcastBodyEntry>(data);
+    allocations += counter.allocations();
+    benchmark::DoNotOptimize(read);
+  }
+  reportCounters(state, data.totalSize(), allocations);
+}
+BENCHMARK(BM_BodyEntryRead)->RangeMultiplier(4)->Range(1 << 10, 4 << 20);
+
+#pragma GCC diagnostic pop
+
+void BM_BodyEntryCopy(benchmark::State& state) {
+  const HazelcastBodyEntry entry = makeBodyEntry(state.range(0));
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    AllocationCounter counter;
+    HazelcastBodyEntry copy(entry);
+    allocations += counter.allocations();
+    benchmark::DoNotOptimize(copy);
+  }
+  reportCounters(state, entry.body_buffer_.size(), allocations);
+}
+BENCHMARK(BM_BodyEntryCopy)->RangeMultiplier(4)->Range(1 << 10, 4 << 20);
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,512 @@
+#include "hazelcast/client/SerializationConfig.h"
+#include "hazelcast/client/serialization/pimpl/SerializationService.h"
+#include "hazelcast_cache_entry.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+using hazelcast::client::serialization::pimpl::Data;
+using hazelcast::client::serialization::pimpl::SerializationService;
+
+/**
+ * Writes an entry in an arbitrary layout with the given class id, to
+ * emulate writers of other versions.
+ */
+class RawEntryWriter : public IdentifiedDataSerializable {
+public:
+  using Writer = std::function<void(ObjectDataOutput&)>;
+
+  RawEntryWriter(int class_id, Writer writer)
+    : class_id_(class_id), writer_(std::move(writer)) {}
+
+  int getFactoryId() const { return HAZELCAST_ENTRY_SERIALIZER_FACTORY_ID; }
+  int getClassId() const { return class_id_; }
+  void writeData(ObjectDataOutput& writer) const { writer_(writer); }
+  void readData(ObjectDataInput&) {}
+
+private:
+  const int class_id_;
+  const Writer writer_;
+};
+
+void writeHeaders(ObjectDataOutput& writer) {
+  std::vector<char> key{':', 's', 't', 'a', 't', 'u', 's'};
+  std::vector<char> value{'2', '0', '0'};
+  writer.writeInt(1);
+  writer.writeCharArray(&key);
+  writer.writeCharArray(&value);
+}
+
+// Version 1 header fields up to the sections. Later versions read
+// these as well.
+void writeHeaderFields(ObjectDataOutput& writer, int32_t features) {
+  writer.writeByte(1);
+  writer.writeInt(features);
+  writeHeaders(writer);
+  writer.writeLong(42); // total body size
+  writer.writeLong(8); // first partition size
+  writer.writeInt(2); // growth factor
+  writer.writeLong(64); // max partition size
+}
+
+/**
+ * Header entry of the releases before versioning, reading the
+ * unversioned format only.
+ */
+class OldHeaderEntry : public IdentifiedDataSerializable {
+public:
+  int getFactoryId() const { return HAZELCAST_ENTRY_SERIALIZER_FACTORY_ID; }
+  int getClassId() const { return HAZELCAST_LEGACY_HEADER_TYPE_ID; }
+  void writeData(ObjectDataOutput&) const {}
+  void readData(ObjectDataInput& reader) {
+    int headers_size = reader.readInt();
+    for (int i = 0; i < headers_size; i++) {
+      std::vector<char> key = *reader.readCharArray();
+      std::vector<char> value = *reader.readCharArray();
+      headers.emplace_back(std::string(key.begin(), key.end()),
+          std::string(value.begin(), value.end()));
+    }
+    total_body_size = reader.readLong();
+  }
+
+  std::vector<std::pair<std::string, std::string>> headers;
+  int64_t total_body_size = 0;
+};
+
+class OldBodyEntry : public IdentifiedDataSerializable {
+public:
+  int getFactoryId() const { return HAZELCAST_ENTRY_SERIALIZER_FACTORY_ID; }
+  int getClassId() const { return HAZELCAST_LEGACY_BODY_TYPE_ID; }
+  void writeData(ObjectDataOutput&) const {}
+  void readData(ObjectDataInput& reader) { body = *reader.readByteArray(); }
+
+  std::vector<hazelcast::byte> body;
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// SerializationService::toObject returns std::auto_ptr.
+// Hence the warnings are suppressed here.
+
+// Factory of the releases before versioning. Unknown class ids yield
+// null, which the client dereferences.
+class OldEntryFactory : public DataSerializableFactory {
+public:
+  std::auto_ptr<IdentifiedDataSerializable> create(int32_t class_id) {
+    switch (class_id) {
+    case HAZELCAST_LEGACY_BODY_TYPE_ID:
+      return std::auto_ptr<IdentifiedDataSerializable>(new OldBodyEntry());
+    case HAZELCAST_LEGACY_HEADER_TYPE_ID:
+      return std::auto_ptr<IdentifiedDataSerializable>(new OldHeaderEntry());
+    default:
+      return std::auto_ptr<IdentifiedDataSerializable>();
+    }
+  }
+};
+
+class HazelcastCacheEntryTest : public testing::Test {
+protected:
+  HazelcastCacheEntryTest() {
+    config_.addDataSerializableFactory(
+        HazelcastCacheEntrySerializableFactory::FACTORY_ID,
+        boost::shared_ptr<hazelcast::client::serialization::DataSerializableFactory>
+            (new HazelcastCacheEntrySerializableFactory()));
+    serializer_ = std::make_unique<SerializationService>(config_);
+    old_config_.addDataSerializableFactory(
+        HazelcastCacheEntrySerializableFactory::FACTORY_ID,
+        boost::shared_ptr<hazelcast::client::serialization::DataSerializableFactory>
+            (new OldEntryFactory()));
+    old_serializer_ = std::make_unique<SerializationService>(old_config_);
+  }
+
+  std::unique_ptr<HazelcastHeaderEntry> readHeader(int class_id,
+      RawEntryWriter::Writer writer) {
+    RawEntryWriter raw(class_id, std::move(writer));
+    const Data data = serializer_->toData<RawEntryWriter>(&raw);
+    return std::unique_ptr<HazelcastHeaderEntry>(
+        serializer_->toObject<HazelcastHeaderEntry>(data).release());
+  }
+
+  std::unique_ptr<HazelcastBodyEntry> readBody(int class_id,
+      RawEntryWriter::Writer writer) {
+    RawEntryWriter raw(class_id, std::move(writer));
+    const Data data = serializer_->toData<RawEntryWriter>(&raw);
+    return std::unique_ptr<HazelcastBodyEntry>(
+        serializer_->toObject<HazelcastBodyEntry>(data).release());
+  }
+
+  template <typename T> std::unique_ptr<T> roundTrip(const T& entry) {
+    const Data data = serializer_->toData<T>(&entry);
+    return std::unique_ptr<T>(serializer_->toObject<T>(data).release());
+  }
+
+  // Reads an entry written by this version as a release before
+  // versioning does.
+  template <typename Old, typename T> std::unique_ptr<Old> readByOldRelease(
+      const T& entry) {
+    const Data data = serializer_->toData<T>(&entry);
+    return std::unique_ptr<Old>(old_serializer_->toObject<Old>(data)
+        .release());
+  }
+
+  hazelcast::client::SerializationConfig config_;
+  std::unique_ptr<SerializationService> serializer_;
+  hazelcast::client::SerializationConfig old_config_;
+  std::unique_ptr<SerializationService> old_serializer_;
+};
+
+#pragma GCC diagnostic pop
+
+TEST_F(HazelcastCacheEntryTest, LegacyHeaderEntry) {
+  std::unique_ptr<HazelcastHeaderEntry> entry = readHeader(
+      HAZELCAST_LEGACY_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaders(writer);
+        writer.writeLong(42);
+      });
+  ASSERT_TRUE(entry->supported());
+  EXPECT_TRUE(entry->legacyFormat());
+  EXPECT_EQ(42, entry->total_body_size);
+  EXPECT_EQ("200", entry->header(":status"));
+  EXPECT_EQ("200", entry->headerMap().Status()->value().getStringView());
+  EXPECT_EQ(HazelcastBodyCodec::None, entry->body_codec);
+  EXPECT_TRUE(entry->partition_keys.empty());
+}
+
+TEST_F(HazelcastCacheEntryTest, LegacyBodyEntry) {
+  std::unique_ptr<HazelcastBodyEntry> entry = readBody(
+      HAZELCAST_LEGACY_BODY_TYPE_ID, [](ObjectDataOutput& writer) {
+        std::vector<hazelcast::byte> body{'b', 'o', 'd', 'y'};
+        writer.writeByteArray(&body);
+      });
+  ASSERT_TRUE(entry->supported());
+  EXPECT_EQ(std::vector<hazelcast::byte>({'b', 'o', 'd', 'y'}),
+      entry->body_buffer_);
+}
+
+TEST_F(HazelcastCacheEntryTest, LegacyFormatReadByOldRelease) {
+  Http::HeaderMapImpl headers;
+  headers.setStatus(200);
+  headers.addCopy(Http::LowerCaseString("x-empty"), "");
+  HazelcastHeaderEntry header;
+  header.setHeaders(headers);
+  header.total_body_size = 42;
+  header.freshness = HazelcastFreshness();
+  header.setLegacyFormat(true);
+  std::unique_ptr<OldHeaderEntry> old_header =
+      readByOldRelease<OldHeaderEntry>(header);
+  ASSERT_TRUE(old_header);
+  EXPECT_EQ(42, old_header->total_body_size);
+  EXPECT_EQ((std::vector<std::pair<std::string, std::string>>{
+      {":status", "200"}, {"x-empty", ""}}), old_header->headers);
+
+  Buffer::OwnedImpl body;
+  body.appendSliceForTest("bo");
+  body.appendSliceForTest("dy");
+  HazelcastBodyEntry partition;
+  partition.setBody(body);
+  partition.setLegacyFormat(true);
+  std::unique_ptr<OldBodyEntry> old_body =
+      readByOldRelease<OldBodyEntry>(partition);
+  ASSERT_TRUE(old_body);
+  EXPECT_EQ(std::vector<hazelcast::byte>({'b', 'o', 'd', 'y'}),
+      old_body->body);
+
+  // Read back by this version as well.
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(header);
+  ASSERT_TRUE(read->supported());
+  EXPECT_TRUE(read->legacyFormat());
+  EXPECT_EQ(42, read->total_body_size);
+  EXPECT_EQ("200", read->header(":status"));
+  EXPECT_FALSE(read->freshness);
+}
+
+TEST_F(HazelcastCacheEntryTest, VersionedFormatUnknownToOldRelease) {
+  // Deserializing would dereference the null entry, hence the reason
+  // for legacy_entry_format.
+  OldEntryFactory factory;
+  EXPECT_FALSE(factory.create(HAZELCAST_HEADER_TYPE_ID).get());
+  EXPECT_FALSE(factory.create(HAZELCAST_BODY_TYPE_ID).get());
+  EXPECT_EQ(HAZELCAST_HEADER_TYPE_ID, HazelcastHeaderEntry().getClassId());
+  EXPECT_EQ(HAZELCAST_BODY_TYPE_ID, HazelcastBodyEntry().getClassId());
+}
+
+TEST_F(HazelcastCacheEntryTest, HeaderEntryRoundTrip) {
+  HazelcastHeaderEntry entry;
+  auto header_map = std::make_unique<Http::HeaderMapImpl>();
+  header_map->setStatus(200);
+  header_map->addCopy(Http::LowerCaseString("x-empty"), "");
+  entry.setHeaderMap(std::move(header_map));
+  entry.total_body_size = 100;
+  entry.partition_schedule = HazelcastPartitionSchedule(8, 2, 64);
+  entry.body_codec = HazelcastBodyCodec::Gzip;
+  entry.encoded_partition_sizes = {10, 20, 30};
+  entry.partition_keys = {"key-0", "key-1", "key-2"};
+  entry.freshness = HazelcastFreshness();
+  entry.freshness->response_time = 1600000000;
+  entry.freshness->freshness_lifetime = 3600;
+  entry.freshness->etag = "\"v1\"";
+  entry.freshness->vary = {"accept-encoding"};
+
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  EXPECT_FALSE(read->legacyFormat());
+  EXPECT_EQ(100, read->total_body_size);
+  EXPECT_EQ(8, read->partition_schedule.firstSize());
+  EXPECT_EQ(2, read->partition_schedule.growthFactor());
+  EXPECT_EQ(64, read->partition_schedule.maxSize());
+  EXPECT_EQ(HazelcastBodyCodec::Gzip, read->body_codec);
+  EXPECT_EQ(entry.encoded_partition_sizes, read->encoded_partition_sizes);
+  EXPECT_EQ(entry.partition_keys, read->partition_keys);
+  EXPECT_EQ("200", read->header(":status"));
+  EXPECT_EQ("", read->header("x-empty"));
+  EXPECT_FALSE(read->header("x-missing"));
+  EXPECT_EQ(2, read->headerMap().size());
+  ASSERT_TRUE(read->freshness);
+  EXPECT_EQ(1600000000, read->freshness->response_time);
+  EXPECT_EQ(3600, read->freshness->freshness_lifetime);
+  EXPECT_EQ("\"v1\"", read->freshness->etag);
+  EXPECT_EQ("", read->freshness->last_modified);
+  EXPECT_EQ(entry.freshness->vary, read->freshness->vary);
+  EXPECT_FALSE(read->hasTrailers());
+  EXPECT_FALSE(read->trailers());
+}
+
+TEST_F(HazelcastCacheEntryTest, TrailersRoundTrip) {
+  HazelcastHeaderEntry entry;
+  entry.setHeaderMap(std::make_unique<Http::HeaderMapImpl>());
+  entry.total_body_size = 0;
+  Http::HeaderMapImpl trailers;
+  trailers.addCopy(Http::LowerCaseString("grpc-status"), "0");
+  entry.setTrailers(trailers);
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  ASSERT_TRUE(read->hasTrailers());
+  Http::HeaderMapImplPtr read_trailers = read->trailers();
+  EXPECT_EQ(1, read_trailers->size());
+  EXPECT_EQ("0", read_trailers->get(Http::LowerCaseString("grpc-status"))
+      ->value().getStringView());
+  // Headers and trailers are kept apart.
+  EXPECT_FALSE(read->header("grpc-status"));
+
+  // The flag requires the section.
+  std::unique_ptr<HazelcastHeaderEntry> missing = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, HAZELCAST_FEATURE_TRAILERS);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(missing->supported());
+
+  std::unique_ptr<HazelcastHeaderEntry> malformed = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, HAZELCAST_FEATURE_TRAILERS);
+        std::vector<hazelcast::byte> payload{0, 0, 0, 9};
+        writer.writeInt(1);
+        writer.writeByte(HAZELCAST_SECTION_TRAILERS);
+        writer.writeByteArray(&payload);
+      });
+  EXPECT_FALSE(malformed->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, VarySpecRoundTrip) {
+  HazelcastHeaderEntry entry;
+  entry.setHeaderMap(std::make_unique<Http::HeaderMapImpl>());
+  entry.total_body_size = 0;
+  entry.vary_spec = {"accept-encoding", "accept-language"};
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  EXPECT_EQ(entry.vary_spec, read->vary_spec);
+  EXPECT_EQ(0, read->headerMap().size());
+}
+
+TEST_F(HazelcastCacheEntryTest, EncodedHeadersRoundTrip) {
+  Http::HeaderMapImpl headers;
+  headers.setStatus(200);
+  headers.addCopy(Http::LowerCaseString("x-repeated"), "1");
+  headers.addCopy(Http::LowerCaseString("x-repeated"), "2");
+  HazelcastHeaderEntry entry;
+  entry.setHeaders(headers);
+  entry.total_body_size = 0;
+  // Readable before the entry is written too.
+  EXPECT_EQ("200", entry.header(":status"));
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  EXPECT_EQ(3, read->headerMap().size());
+  EXPECT_EQ("200", read->header(":status"));
+  EXPECT_EQ("1", read->header("x-repeated"));
+}
+
+TEST_F(HazelcastCacheEntryTest, CopiesShareHeaderBytes) {
+  Http::HeaderMapImpl headers;
+  headers.setStatus(200);
+  Http::HeaderMapImpl trailers;
+  trailers.addCopy(Http::LowerCaseString("grpc-status"), "0");
+  HazelcastHeaderEntry entry;
+  entry.setHeaders(headers);
+  entry.setTrailers(trailers);
+  entry.total_body_size = 0;
+  std::unique_ptr<HazelcastHeaderEntry> read = roundTrip(entry);
+  HazelcastHeaderEntry copy(*read);
+  // Values of both point into the same bytes.
+  EXPECT_EQ(read->header(":status")->data(), copy.header(":status")->data());
+  // Building the map of one leaves the other serialized and intact.
+  EXPECT_EQ(1, read->headerMap().size());
+  EXPECT_EQ("200", copy.header(":status"));
+  EXPECT_TRUE(copy.hasTrailers());
+  std::unique_ptr<HazelcastHeaderEntry> read_copy = roundTrip(copy);
+  EXPECT_EQ("200", read_copy->header(":status"));
+  EXPECT_EQ(1, read_copy->trailers()->size());
+}
+
+TEST_F(HazelcastCacheEntryTest, BodyEntryRoundTrip) {
+  HazelcastBodyEntry entry;
+  entry.body_buffer_ = {1, 2, 3};
+  std::unique_ptr<HazelcastBodyEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  EXPECT_EQ(entry.body_buffer_, read->body_buffer_);
+}
+
+TEST_F(HazelcastCacheEntryTest, BodyEntryFromSlices) {
+  Buffer::OwnedImpl body;
+  body.appendSliceForTest("abc");
+  body.appendSliceForTest("");
+  body.appendSliceForTest("defg");
+  HazelcastBodyEntry entry;
+  entry.setBody(body);
+  EXPECT_EQ(0, body.length());
+  std::unique_ptr<HazelcastBodyEntry> read = roundTrip(entry);
+  ASSERT_TRUE(read->supported());
+  EXPECT_EQ(std::vector<hazelcast::byte>({'a', 'b', 'c', 'd', 'e', 'f', 'g'}),
+      read->body_buffer_);
+  // Copies keep the slices.
+  EXPECT_EQ(read->body_buffer_, roundTrip(HazelcastBodyEntry(entry))
+      ->body_buffer_);
+}
+
+TEST_F(HazelcastCacheEntryTest, UnknownSectionsSkipped) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, 0);
+        std::vector<hazelcast::byte> payload{1, 2, 3, 4};
+        writer.writeInt(1);
+        writer.writeByte(99);
+        writer.writeByteArray(&payload);
+      });
+  ASSERT_TRUE(header->supported());
+  EXPECT_EQ(42, header->total_body_size);
+  EXPECT_EQ(8, header->partition_schedule.firstSize());
+  EXPECT_FALSE(header->freshness);
+
+  std::unique_ptr<HazelcastBodyEntry> body = readBody(
+      HAZELCAST_BODY_TYPE_ID, [](ObjectDataOutput& writer) {
+        std::vector<hazelcast::byte> body{'b'};
+        std::vector<hazelcast::byte> payload{1, 2, 3, 4};
+        writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION);
+        writer.writeInt(0);
+        writer.writeByteArray(&body);
+        writer.writeInt(1);
+        writer.writeByte(99);
+        writer.writeByteArray(&payload);
+      });
+  ASSERT_TRUE(body->supported());
+  EXPECT_EQ(std::vector<hazelcast::byte>({'b'}), body->body_buffer_);
+}
+
+TEST_F(HazelcastCacheEntryTest, MalformedHeadersUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writer.writeByte(2);
+        writer.writeInt(0);
+        // Key length beyond the end.
+        std::vector<hazelcast::byte> header_bytes{0, 0, 0, 9, 'k'};
+        writer.writeByteArray(&header_bytes);
+        writer.writeLong(0);
+        writer.writeLong(8);
+        writer.writeInt(1);
+        writer.writeLong(8);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(header->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, UnknownFeatureUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, 1 << 7);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(header->supported());
+
+  std::unique_ptr<HazelcastBodyEntry> body = readBody(
+      HAZELCAST_BODY_TYPE_ID, [](ObjectDataOutput& writer) {
+        writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION);
+        writer.writeInt(1);
+      });
+  EXPECT_FALSE(body->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, NewerVersionUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION + 1);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(header->supported());
+
+  std::unique_ptr<HazelcastBodyEntry> body = readBody(
+      HAZELCAST_BODY_TYPE_ID, [](ObjectDataOutput& writer) {
+        writer.writeByte(HAZELCAST_ENTRY_FORMAT_VERSION + 1);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(body->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, MissingFeatureSectionUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, HAZELCAST_FEATURE_COMPRESSED_BODY);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(header->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, InvalidScheduleUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writer.writeByte(2);
+        writer.writeInt(0);
+        std::vector<hazelcast::byte> header_bytes;
+        writer.writeByteArray(&header_bytes);
+        writer.writeLong(0);
+        // Zero sized first partition.
+        writer.writeLong(0);
+        writer.writeInt(2);
+        writer.writeLong(64);
+        writer.writeInt(0);
+      });
+  EXPECT_FALSE(header->supported());
+}
+
+TEST_F(HazelcastCacheEntryTest, MalformedSectionUnsupported) {
+  std::unique_ptr<HazelcastHeaderEntry> header = readHeader(
+      HAZELCAST_HEADER_TYPE_ID, [](ObjectDataOutput& writer) {
+        writeHeaderFields(writer, HAZELCAST_FEATURE_CONTENT_ADDRESSED_BODY);
+        // Claims a key count but has no keys.
+        std::vector<hazelcast::byte> payload{0, 0, 0, 0, 0, 0, 0, 2};
+        writer.writeInt(1);
+        writer.writeByte(HAZELCAST_SECTION_PARTITION_KEYS);
+        writer.writeByteArray(&payload);
+      });
+  EXPECT_FALSE(header->supported());
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,431 @@
+// Note: this should be run with --compilation_mode=opt, and would benefit from
+// a quiescent system with disabled cstate power management.
+//
+// Load benchmark of the cache over the in-process storage backend. Worker
+// threads issue requests the way the cache filter does: a lookup first,
+// then either the body is fetched partition by partition (hit) or the
+// response is streamed into an insert context (miss).
+//
+// Workload is configured by flags (defaults in LoadOptions):
+//   --keys=N               number of distinct URLs.
+//   --zipf_exponent=S      skew of the key popularity (0 is uniform).
+//   --sizes=B:W,...        response body sizes in bytes with their weights.
+//   --range_percentage=P   percentage of requests with a Range header.
+//   --threads=N            concurrent workers.
+//   --requests=N           requests per worker.
+//   --partition_size=B     body_partition_size of the cache.
+//   --first_partition_size=B, --growth_factor=R
+//                          geometric partition schedule up to
+//                          partition_size, if first_partition_size is set.
+//   --latency_us=U, --jitter_us=U  latency injected by the backend.
+//   --seed=N               seed of the workload generators.
+//   --output=PATH          also write the results to the given file.
+//
+// Results are printed as a single JSON object to stdout.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "common/common/utility.h"
+#include "common/http/header_map_impl.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "hazelcast_fault_injecting_backend.h"
+#include "hazelcast_http_cache.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+struct LoadOptions {
+  uint64_t keys = 10000;
+  double zipf_exponent = 0.99;
+  // Body size and weight pairs.
+  std::vector<std::pair<uint64_t, double>> sizes{
+      {1024, 40}, {16 * 1024, 40}, {256 * 1024, 15}, {1024 * 1024, 5}};
+  double range_percentage = 10;
+  uint32_t threads = 4;
+  uint64_t requests = 20000;
+  uint64_t partition_size = 64 * 1024;
+  uint64_t first_partition_size = 0;
+  uint32_t growth_factor = 2;
+  uint32_t latency_us = 0;
+  uint32_t jitter_us = 0;
+  uint64_t seed = 1;
+  std::string output;
+};
+
+bool parseSizes(absl::string_view value,
+    std::vector<std::pair<uint64_t, double>>& sizes) {
+  sizes.clear();
+  for (absl::string_view item : absl::StrSplit(value, ',')) {
+    std::pair<absl::string_view, absl::string_view> size_and_weight =
+        absl::StrSplit(item, ':');
+    uint64_t size;
+    double weight;
+    if (!absl::SimpleAtoi(size_and_weight.first, &size) ||
+        !absl::SimpleAtod(size_and_weight.second, &weight) || weight < 0) {
+      return false;
+    }
+    sizes.emplace_back(size, weight);
+  }
+  return !sizes.empty();
+}
+
+bool parseOptions(int argc, char** argv, LoadOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    std::pair<absl::string_view, absl::string_view> flag =
+        absl::StrSplit(argv[i], absl::MaxSplits('=', 1));
+    const absl::string_view name = flag.first;
+    const absl::string_view value = flag.second;
+    bool valid;
+    if (name == "--keys") {
+      valid = absl::SimpleAtoi(value, &options.keys) && options.keys > 0;
+    } else if (name == "--zipf_exponent") {
+      valid = absl::SimpleAtod(value, &options.zipf_exponent);
+    } else if (name == "--sizes") {
+      valid = parseSizes(value, options.sizes);
+    } else if (name == "--range_percentage") {
+      valid = absl::SimpleAtod(value, &options.range_percentage);
+    } else if (name == "--threads") {
+      valid = absl::SimpleAtoi(value, &options.threads) && options.threads > 0;
+    } else if (name == "--requests") {
+      valid = absl::SimpleAtoi(value, &options.requests);
+    } else if (name == "--partition_size") {
+      valid = absl::SimpleAtoi(value, &options.partition_size) &&
+          options.partition_size > 0;
+    } else if (name == "--first_partition_size") {
+      valid = absl::SimpleAtoi(value, &options.first_partition_size);
+    } else if (name == "--growth_factor") {
+      valid = absl::SimpleAtoi(value, &options.growth_factor) &&
+          options.growth_factor > 0;
+    } else if (name == "--latency_us") {
+      valid = absl::SimpleAtoi(value, &options.latency_us);
+    } else if (name == "--jitter_us") {
+      valid = absl::SimpleAtoi(value, &options.jitter_us);
+    } else if (name == "--seed") {
+      valid = absl::SimpleAtoi(value, &options.seed);
+    } else if (name == "--output") {
+      options.output = std::string(value);
+      valid = !value.empty();
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      std::cerr << "invalid flag: " << argv[i] << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Draws ranks in [0, n) where rank k has a probability
+// proportional to 1 / (k + 1)^exponent.
+class ZipfianGenerator {
+public:
+  ZipfianGenerator(uint64_t n, double exponent) : cdf_(n) {
+    double sum = 0;
+    for (uint64_t k = 0; k < n; k++) {
+      sum += 1.0 / std::pow(k + 1, exponent);
+      cdf_[k] = sum;
+    }
+    for (double& value : cdf_) {
+      value /= sum;
+    }
+  }
+
+  uint64_t next(std::mt19937_64& random) {
+    const double u = std::uniform_real_distribution<double>(0, 1)(random);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    return it == cdf_.end() ? cdf_.size() - 1 : it - cdf_.begin();
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+// Per worker results.
+struct WorkerResult {
+  std::vector<uint64_t> hit_latencies_us;
+  std::vector<uint64_t> miss_latencies_us;
+  uint64_t range_requests = 0;
+  uint64_t body_bytes_served = 0;
+  uint64_t body_bytes_inserted = 0;
+  uint64_t errors = 0;
+};
+
+class LoadRunner {
+public:
+  LoadRunner(const LoadOptions& options) : options_(options),
+      zipfian_(options.keys, options.zipf_exponent) {
+    HazelcastConfig config;
+    config.set_body_partition_size(options.partition_size);
+    if (options.first_partition_size) {
+      PartitionSchedule* schedule = config.mutable_partition_schedule();
+      schedule->set_first_size(options.first_partition_size);
+      schedule->set_growth_factor(options.growth_factor);
+      schedule->set_max_size(options.partition_size);
+    }
+    StorageFaults faults;
+    faults.latency_us = options.latency_us;
+    faults.jitter_us = options.jitter_us;
+    cache_ = std::make_unique<HazelcastHttpCache>(config,
+        std::make_unique<FaultInjectingStorageBackend>(faults, options.seed));
+
+    // Body size of each key is fixed, as it would be for a URL.
+    std::mt19937_64 random(options.seed);
+    std::vector<double> weights;
+    for (const auto& size : options.sizes) {
+      weights.push_back(size.second);
+    }
+    std::discrete_distribution<size_t> size_distribution(weights.begin(),
+        weights.end());
+    key_sizes_.reserve(options.keys);
+    for (uint64_t k = 0; k < options.keys; k++) {
+      key_sizes_.push_back(options.sizes[size_distribution(random)].first);
+    }
+  }
+
+  void run() {
+    std::vector<std::thread> threads;
+    results_.resize(options_.threads);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < options_.threads; t++) {
+      threads.emplace_back([this, t]() { runWorker(t, results_[t]); });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    elapsed_ = std::chrono::steady_clock::now() - start;
+  }
+
+  std::string report() {
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> misses;
+    uint64_t range_requests = 0;
+    uint64_t bytes_served = 0;
+    uint64_t bytes_inserted = 0;
+    uint64_t errors = 0;
+    for (const WorkerResult& result : results_) {
+      hits.insert(hits.end(), result.hit_latencies_us.begin(),
+          result.hit_latencies_us.end());
+      misses.insert(misses.end(), result.miss_latencies_us.begin(),
+          result.miss_latencies_us.end());
+      range_requests += result.range_requests;
+      bytes_served += result.body_bytes_served;
+      bytes_inserted += result.body_bytes_inserted;
+      errors += result.errors;
+    }
+    std::vector<uint64_t> all(hits);
+    all.insert(all.end(), misses.begin(), misses.end());
+
+    const double seconds = std::chrono::duration<double>(elapsed_).count();
+    const uint64_t requests = all.size();
+    std::string operations;
+    HazelcastOperationStats& stats = cache_->operationStats();
+    for (size_t i = 0; i < static_cast<size_t>(HazelcastOperation::Count);
+         i++) {
+      HazelcastOperation operation = static_cast<HazelcastOperation>(i);
+      absl::StrAppend(&operations, i == 0 ? "" : ", ", fmt::format(
+          "\"{}\": {{\"completed\": {}, \"latency_us\": {}}}",
+          HazelcastOperationStats::operationName(operation),
+          stats.completed(operation),
+          percentilesJson(stats.latencyPercentiles(operation,
+              {50, 99, 99.9}))));
+    }
+
+    return fmt::format("{{\n"
+        "  \"options\": {{\"keys\": {}, \"zipf_exponent\": {}, "
+        "\"range_percentage\": {}, \"threads\": {}, "
+        "\"requests_per_thread\": {}, \"partition_size\": {}, "
+        "\"first_partition_size\": {}, \"growth_factor\": {}, "
+        "\"latency_us\": {}, \"jitter_us\": {}, \"seed\": {}}},\n"
+        "  \"elapsed_seconds\": {:.3f},\n"
+        "  \"requests\": {},\n"
+        "  \"throughput_rps\": {:.1f},\n"
+        "  \"hits\": {},\n"
+        "  \"misses\": {},\n"
+        "  \"hit_ratio\": {:.4f},\n"
+        "  \"range_requests\": {},\n"
+        "  \"errors\": {},\n"
+        "  \"bytes_served\": {},\n"
+        "  \"bytes_inserted\": {},\n"
+        "  \"bytes_per_hit\": {:.1f},\n"
+        "  \"latency_us\": {{\"all\": {}, \"hit\": {}, \"miss\": {}}},\n"
+        "  \"operations\": {{{}}}\n"
+        "}}\n",
+        options_.keys, options_.zipf_exponent, options_.range_percentage,
+        options_.threads, options_.requests, options_.partition_size,
+        options_.first_partition_size, options_.growth_factor,
+        options_.latency_us, options_.jitter_us, options_.seed,
+        seconds, requests, seconds > 0 ? requests / seconds : 0,
+        hits.size(), misses.size(),
+        requests ? static_cast<double>(hits.size()) / requests : 0,
+        range_requests, errors, bytes_served, bytes_inserted,
+        hits.empty() ? 0 : static_cast<double>(bytes_served) / hits.size(),
+        percentilesJson(percentiles(all)), percentilesJson(percentiles(hits)),
+        percentilesJson(percentiles(misses)), operations);
+  }
+
+private:
+  void runWorker(uint32_t index, WorkerResult& result) {
+    std::mt19937_64 random(options_.seed + index + 1);
+    std::uniform_real_distribution<double> percentage(0, 100);
+    DateFormatter formatter("%a, %d %b %Y %H:%M:%S GMT");
+    Http::HeaderMapImpl request_headers;
+    request_headers.setMethod("GET");
+    request_headers.setHost("example.com");
+    request_headers.setForwardedProto("https");
+    request_headers.setCacheControl("max-age=3600");
+    result.hit_latencies_us.reserve(options_.requests);
+
+    for (uint64_t i = 0; i < options_.requests; i++) {
+      const uint64_t key = zipfian_.next(random);
+      const uint64_t size = key_sizes_[key];
+      request_headers.setPath(absl::StrCat("/object/", key));
+      request_headers.remove(RANGE);
+      if (size > 0 && percentage(random) < options_.range_percentage) {
+        const uint64_t first =
+            std::uniform_int_distribution<uint64_t>(0, size - 1)(random);
+        const uint64_t last =
+            std::uniform_int_distribution<uint64_t>(first, size - 1)(random);
+        request_headers.addCopy(RANGE, fmt::format("bytes={}-{}", first, last));
+        result.range_requests++;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      const SystemTime now = std::chrono::system_clock::now();
+      LookupContextPtr context = cache_->makeLookupContext(
+          LookupRequest(request_headers, now));
+      LookupResult lookup_result;
+      context->getHeaders([&lookup_result](LookupResult&& result) {
+        lookup_result = std::move(result);
+      });
+
+      if (lookup_result.cache_entry_status_ == CacheEntryStatus::Ok) {
+        if (!fetchBody(*context, lookup_result, result)) {
+          result.errors++;
+        }
+        result.hit_latencies_us.push_back(elapsedMicros(start));
+      } else {
+        insert(std::move(context), formatter.fromTime(now), size, result);
+        result.miss_latencies_us.push_back(elapsedMicros(start));
+      }
+    }
+  }
+
+  // Fetches the (requested range of the) body like the filter does.
+  bool fetchBody(LookupContext& context, const LookupResult& lookup_result,
+      WorkerResult& result) {
+    uint64_t begin = 0;
+    uint64_t end = lookup_result.content_length_;
+    if (!lookup_result.response_ranges_.empty()) {
+      begin = lookup_result.response_ranges_[0].begin();
+      end = lookup_result.response_ranges_[0].end();
+    }
+    while (begin < end) {
+      uint64_t received = 0;
+      context.getBody(AdjustedByteRange(begin, end),
+          [&received](Buffer::InstancePtr&& data) {
+        if (data) received = data->length();
+      });
+      if (received == 0) {
+        return false;
+      }
+      begin += received;
+      result.body_bytes_served += received;
+    }
+    return true;
+  }
+
+  // Streams the response into the cache in chunks of an
+  // upstream read.
+  void insert(LookupContextPtr&& context, const std::string& date,
+      uint64_t size, WorkerResult& result) {
+    Http::HeaderMapImpl response_headers;
+    response_headers.insertStatus().value(200);
+    response_headers.insertDate().value(date);
+    response_headers.setCacheControl("public, max-age=3600");
+    InsertContextPtr inserter = cache_->makeInsertContext(std::move(context));
+    inserter->insertHeaders(response_headers, size == 0);
+    const std::string chunk(std::min<uint64_t>(size, UPSTREAM_CHUNK_SIZE),
+        'x');
+    uint64_t remaining = size;
+    while (remaining > 0) {
+      const uint64_t length = std::min<uint64_t>(remaining, chunk.size());
+      remaining -= length;
+      inserter->insertBody(Buffer::OwnedImpl(chunk.data(), length), nullptr,
+          remaining == 0);
+    }
+    result.body_bytes_inserted += size;
+  }
+
+  static uint64_t elapsedMicros(
+      const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  // p50, p99 and p999 with nearest rank.
+  static std::vector<uint64_t> percentiles(std::vector<uint64_t>& samples) {
+    std::vector<uint64_t> values;
+    std::sort(samples.begin(), samples.end());
+    for (double p : {50.0, 99.0, 99.9}) {
+      if (samples.empty()) {
+        values.push_back(0);
+        continue;
+      }
+      size_t rank = static_cast<size_t>(std::ceil(p / 100 * samples.size()));
+      values.push_back(samples[std::max<size_t>(rank, 1) - 1]);
+    }
+    return values;
+  }
+
+  static std::string percentilesJson(const std::vector<uint64_t>& values) {
+    return fmt::format("{{\"p50\": {}, \"p99\": {}, \"p999\": {}}}",
+        values[0], values[1], values[2]);
+  }
+
+  static const uint64_t UPSTREAM_CHUNK_SIZE = 16 * 1024;
+  static const Http::LowerCaseString RANGE;
+
+  const LoadOptions options_;
+  ZipfianGenerator zipfian_;
+  std::vector<uint64_t> key_sizes_;
+  std::unique_ptr<HazelcastHttpCache> cache_;
+  std::vector<WorkerResult> results_;
+  std::chrono::steady_clock::duration elapsed_;
+};
+
+const Http::LowerCaseString LoadRunner::RANGE{"range"};
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  using Envoy::Extensions::HttpFilters::Cache::LoadOptions;
+  using Envoy::Extensions::HttpFilters::Cache::LoadRunner;
+  LoadOptions options;
+  if (!Envoy::Extensions::HttpFilters::Cache::parseOptions(argc, argv,
+      options)) {
+    return 1;
+  }
+  LoadRunner runner(options);
+  runner.run();
+  const std::string report = runner.report();
+  std::cout << report;
+  if (!options.output.empty()) {
+    std::ofstream(options.output) << report;
+  }
+  return 0;
+}
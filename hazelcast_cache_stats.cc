@@ -0,0 +1,109 @@
+#include "hazelcast_cache_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+HazelcastOperationStats::HazelcastOperationStats() : in_flight_(0) {};
+
+HazelcastOperationStats::TimePoint HazelcastOperationStats::begin() {
+  in_flight_++;
+  return std::chrono::steady_clock::now();
+}
+
+void HazelcastOperationStats::end(HazelcastOperation operation,
+    const TimePoint& start) {
+  in_flight_--;
+  record(operation, std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now() - start).count());
+}
+
+uint64_t HazelcastOperationStats::completed(HazelcastOperation operation) {
+  uint64_t completed = 0;
+  windows_.forEach([operation, &completed](LatencyWindows& windows) {
+    completed += windows[static_cast<size_t>(operation)].recorded.load();
+  });
+  return completed;
+}
+
+std::vector<uint64_t> HazelcastOperationStats::latencyPercentiles(
+    HazelcastOperation operation, const std::vector<double>& percentiles) {
+  std::vector<uint64_t> samples;
+  windows_.forEach([operation, &samples](LatencyWindows& windows) {
+    const LatencyWindow& window = windows[static_cast<size_t>(operation)];
+    const size_t size = std::min<uint64_t>(window.recorded.load(),
+        WINDOW_SIZE);
+    for (size_t i = 0; i < size; i++) {
+      samples.push_back(window.samples[i].load(std::memory_order_relaxed));
+    }
+  });
+  std::vector<uint64_t> result(percentiles.size(), 0);
+  if (samples.empty()) {
+    return result;
+  }
+  std::sort(samples.begin(), samples.end());
+  for (size_t i = 0; i < percentiles.size(); i++) {
+    // Nearest rank
+    double rank = std::ceil(percentiles[i] / 100 * samples.size());
+    size_t index = rank < 1 ? 0 : static_cast<size_t>(rank) - 1;
+    result[i] = samples[std::min(index, samples.size() - 1)];
+  }
+  return result;
+}
+
+const char* HazelcastOperationStats::operationName(
+    HazelcastOperation operation) {
+  switch (operation) {
+  case HazelcastOperation::LookupHeader:
+    return "lookup_header";
+  case HazelcastOperation::LookupBody:
+    return "lookup_body";
+  case HazelcastOperation::InsertHeader:
+    return "insert_header";
+  case HazelcastOperation::InsertBody:
+    return "insert_body";
+  default:
+    return "unknown";
+  }
+}
+
+const char* HazelcastInsertStats::reasonName(HazelcastInsertSkip reason) {
+  switch (reason) {
+  case HazelcastInsertSkip::TooLarge:
+    return "too_large";
+  case HazelcastInsertSkip::AbortedTooLarge:
+    return "aborted_too_large";
+  case HazelcastInsertSkip::MemoryBudget:
+    return "memory_budget";
+  case HazelcastInsertSkip::AbortedMemoryBudget:
+    return "aborted_memory_budget";
+  case HazelcastInsertSkip::RateLimited:
+    return "rate_limited";
+  case HazelcastInsertSkip::AbortedRateLimited:
+    return "aborted_rate_limited";
+  case HazelcastInsertSkip::QueueLimit:
+    return "queue_limit";
+  case HazelcastInsertSkip::LegacyFormat:
+    return "legacy_format";
+  default:
+    return "unknown";
+  }
+}
+
+void HazelcastOperationStats::record(HazelcastOperation operation,
+    uint64_t latency_us) {
+  LatencyWindow& window = windows_.local()[static_cast<size_t>(operation)];
+  const uint64_t recorded = window.recorded.load(std::memory_order_relaxed);
+  window.samples[recorded % WINDOW_SIZE].store(latency_us,
+      std::memory_order_relaxed);
+  window.recorded.store(recorded + 1, std::memory_order_release);
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "hazelcast_thread_shards.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Kinds of Hazelcast round trips made by the cache.
+ */
+enum class HazelcastOperation {
+  LookupHeader = 0,
+  LookupBody,
+  InsertHeader,
+  InsertBody,
+  Count // number of operation kinds, not an operation.
+};
+
+/**
+ * Runtime statistics of the Hazelcast operations made by the cache.
+ *
+ * Keeps the number of operations currently in flight and the latencies
+ * of the most recent operations per kind. These are used for cache
+ * introspection (see hazelcast_cache_admin.h) and are shared by all
+ * workers, hence thread safe.
+ *
+ * Latencies are recorded on the shard of the calling thread, written
+ * by that thread only, hence without locking on the hit path. Readers
+ * merge the samples of all shards.
+ */
+class HazelcastOperationStats {
+public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  HazelcastOperationStats();
+
+  // Marks the start of an operation. The returned time point has
+  // to be passed to end() when the operation is completed.
+  TimePoint begin();
+  void end(HazelcastOperation operation, const TimePoint& start);
+
+  uint64_t inFlight() const { return in_flight_.load(); }
+
+  // Total number of completed operations of the given kind.
+  uint64_t completed(HazelcastOperation operation);
+
+  // Latencies in microseconds for the given percentiles (0-100) over
+  // the recent samples of all threads. Zeros are returned if nothing is
+  // recorded yet.
+  std::vector<uint64_t> latencyPercentiles(HazelcastOperation operation,
+      const std::vector<double>& percentiles);
+
+  static const char* operationName(HazelcastOperation operation);
+
+private:
+  void record(HazelcastOperation operation, uint64_t latency_us);
+
+  // Number of recent samples kept per operation kind and thread.
+  static const size_t WINDOW_SIZE = 1024;
+
+  // Written by the thread of its shard only. Readers may see a sample
+  // being overwritten, which is harmless for statistics.
+  struct LatencyWindow {
+    std::array<std::atomic<uint64_t>, WINDOW_SIZE> samples{};
+    std::atomic<uint64_t> recorded{0};
+  };
+
+  using LatencyWindows = std::array<LatencyWindow,
+      static_cast<size_t>(HazelcastOperation::Count)>;
+
+  std::atomic<uint64_t> in_flight_;
+  HazelcastThreadShards<LatencyWindows> windows_;
+};
+
+/**
+ * Reasons for the cache to not store a cacheable response.
+ */
+enum class HazelcastInsertSkip {
+  // Content-Length exceeds max_object_size, nothing is written.
+  TooLarge = 0,
+  // The body exceeded max_object_size while streaming, partitions
+  // written before are removed.
+  AbortedTooLarge,
+  // The insert memory budget was exhausted when the body started,
+  // nothing is written.
+  MemoryBudget,
+  // The budget was exhausted while the body streamed, partitions
+  // written before are removed.
+  AbortedMemoryBudget,
+  // The insert rate limit was exceeded by the first partition, nothing
+  // is written.
+  RateLimited,
+  // A later partition exceeded the rate limit, partitions written
+  // before are removed.
+  AbortedRateLimited,
+  // In write-behind mode, the body exceeded the bytes a worker may
+  // queue. Nothing is written.
+  QueueLimit,
+  // The response has Vary or trailers, which legacy_entry_format
+  // cannot store. Partitions written before are removed.
+  LegacyFormat,
+  Count // number of reasons, not a reason.
+};
+
+/**
+ * Number of responses not stored per reason, shared by all workers.
+ */
+class HazelcastInsertStats {
+public:
+  void record(HazelcastInsertSkip reason) {
+    skipped_[static_cast<size_t>(reason)]++;
+  }
+
+  uint64_t skipped(HazelcastInsertSkip reason) const {
+    return skipped_[static_cast<size_t>(reason)].load();
+  }
+
+  static const char* reasonName(HazelcastInsertSkip reason);
+
+private:
+  std::array<std::atomic<uint64_t>,
+      static_cast<size_t>(HazelcastInsertSkip::Count)> skipped_{};
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,93 @@
+#include "hazelcast_cache_tracer.h"
+
+#include <random>
+
+#include "common/tracing/http_tracer_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/// HazelcastCacheSpan
+
+HazelcastCacheSpan::HazelcastCacheSpan(Tracing::Span& parent,
+    const std::string& operation, bool sampled) {
+  if (sampled) {
+    span_ = parent.spawnChild(Tracing::EgressConfig::get(), operation,
+        std::chrono::system_clock::now());
+  }
+}
+
+HazelcastCacheSpan::~HazelcastCacheSpan() {
+  finish();
+}
+
+void HazelcastCacheSpan::finish() {
+  if (span_) {
+    span_->finishSpan();
+    span_.reset();
+  }
+}
+
+void HazelcastCacheSpan::setTag(absl::string_view name,
+    absl::string_view value) {
+  if (span_) {
+    span_->setTag(name, value);
+  }
+}
+
+void HazelcastCacheSpan::setTag(absl::string_view name, uint64_t value) {
+  if (span_) {
+    span_->setTag(name, std::to_string(value));
+  }
+}
+
+void HazelcastCacheSpan::setError() {
+  if (span_) {
+    span_->setTag(Tracing::Tags::get().Error, Tracing::Tags::get().True);
+  }
+}
+
+/// HazelcastCacheTracer
+
+const std::string HazelcastCacheTracer::LOOKUP_HEADER =
+    "hazelcast_cache.lookup_header";
+const std::string HazelcastCacheTracer::LOOKUP_BODY =
+    "hazelcast_cache.lookup_body";
+const std::string HazelcastCacheTracer::INSERT_HEADER =
+    "hazelcast_cache.insert_header";
+const std::string HazelcastCacheTracer::INSERT_BODY =
+    "hazelcast_cache.insert_body";
+
+const std::string HazelcastCacheTracer::TAG_HASH_KEY = "hash_key";
+const std::string HazelcastCacheTracer::TAG_PARTITION_INDEX =
+    "partition_index";
+const std::string HazelcastCacheTracer::TAG_BYTES = "bytes";
+const std::string HazelcastCacheTracer::TAG_BODY_SIZE = "body_size";
+const std::string HazelcastCacheTracer::TAG_MEMBER_ADDRESS = "member_address";
+
+HazelcastCacheTracer::HazelcastCacheTracer(const HazelcastConfig& config) :
+  sample_percentage_(std::min<uint32_t>(config.tracing_sample_percentage(),
+      100)),
+  trace_body_partitions_(config.trace_body_partitions()) {};
+
+HazelcastCacheSpanPtr HazelcastCacheTracer::spawn(Tracing::Span& parent,
+    const std::string& operation, bool sampled) {
+  return sampled ?
+      std::make_shared<HazelcastCacheSpan>(parent, operation, true) : nullptr;
+}
+
+bool HazelcastCacheTracer::sampled() const {
+  if (sample_percentage_ == 0 || sample_percentage_ == 100) {
+    return sample_percentage_ == 100;
+  }
+  // A generator per thread, so workers draw without locking.
+  thread_local std::mt19937_64 generator{std::random_device{}()};
+  return generator() % 100 < sample_percentage_;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
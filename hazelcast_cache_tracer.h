@@ -0,0 +1,87 @@
+#pragma once
+
+#include "envoy/tracing/http_tracer.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Child span of the active request span covering a single Hazelcast
+ * round trip (header lookup, body partition fetch, insert flush).
+ *
+ * The span is spawned on construction and finished on destruction,
+ * hence its duration is the scope of the cache operation. If the
+ * owning context is not sampled, no span is spawned and tags are
+ * dropped without any allocation.
+ */
+class HazelcastCacheSpan {
+public:
+  HazelcastCacheSpan(Tracing::Span& parent, const std::string& operation,
+      bool sampled);
+  ~HazelcastCacheSpan();
+
+  void setTag(absl::string_view name, absl::string_view value);
+  void setTag(absl::string_view name, uint64_t value);
+
+  // Marks the operation as failed (i.e. a missing body partition).
+  void setError();
+
+  // Finishes the span before destruction. No-op if already finished.
+  void finish();
+
+  inline bool sampled() const { return span_ != nullptr; }
+
+private:
+  Tracing::SpanPtr span_;
+};
+
+// Spans are shared with the storage callbacks completing them.
+using HazelcastCacheSpanPtr = std::shared_ptr<HazelcastCacheSpan>;
+
+/**
+ * Decides which cache operations are traced.
+ *
+ * Sampling is decided once per request by a random draw, so every key
+ * is traced at the sampled rate. The insert following a lookup takes
+ * the decision of the lookup, hence all spans of a request are either
+ * reported together or not at all.
+ */
+class HazelcastCacheTracer {
+public:
+  HazelcastCacheTracer(const HazelcastConfig& config);
+
+  // Draws the sampling decision of a request.
+  bool sampled() const;
+  inline bool traceBodyPartitions() const { return trace_body_partitions_; }
+
+  // Spawns a span for an operation, or returns nullptr if not sampled.
+  static HazelcastCacheSpanPtr spawn(Tracing::Span& parent,
+      const std::string& operation, bool sampled);
+
+  // Operation names of the spawned spans.
+  static const std::string LOOKUP_HEADER;
+  static const std::string LOOKUP_BODY;
+  static const std::string INSERT_HEADER;
+  static const std::string INSERT_BODY;
+
+  // Tag names of the spawned spans.
+  static const std::string TAG_HASH_KEY;
+  static const std::string TAG_PARTITION_INDEX;
+  // Bytes of the partition read or written, on body spans only.
+  static const std::string TAG_BYTES;
+  // Body size of the response, on header spans.
+  static const std::string TAG_BODY_SIZE;
+  static const std::string TAG_MEMBER_ADDRESS;
+
+private:
+  const uint32_t sample_percentage_;
+  const bool trace_body_partitions_;
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
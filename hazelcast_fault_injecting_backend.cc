@@ -0,0 +1,129 @@
+#include "hazelcast_fault_injecting_backend.h"
+
+#include <thread>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+FaultInjectingStorageBackend::FaultInjectingStorageBackend(
+    const StorageFaults& faults, uint64_t seed) :
+  faults_(faults), random_(seed) {}
+
+void FaultInjectingStorageBackend::getHeader(const uint64_t& hash_key,
+    HeaderLookupCallback&& cb) {
+  if (!simulate(true)) {
+    cb(nullptr);
+    return;
+  }
+  LocalStorageBackend::getHeader(hash_key, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::getBody(absl::string_view key,
+    BodyLookupCallback&& cb) {
+  if (!simulate(true)) {
+    cb(nullptr);
+    return;
+  }
+  LocalStorageBackend::getBody(key, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::putHeader(const uint64_t& hash_key,
+    const HazelcastHeaderEntry& entry, StorageCallback&& cb) {
+  if (!simulate(false)) {
+    cb(false);
+    return;
+  }
+  LocalStorageBackend::putHeader(hash_key, entry, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::putBody(const std::string& key,
+    const HazelcastBodyEntry& entry, StorageCallback&& cb) {
+  if (!simulate(false)) {
+    cb(false);
+    return;
+  }
+  LocalStorageBackend::putBody(key, entry, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::removeBody(const std::string& key,
+    StorageCallback&& cb) {
+  if (!simulate(false)) {
+    cb(false);
+    return;
+  }
+  LocalStorageBackend::removeBody(key, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::putHeaders(
+    const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+    StorageCallback&& cb) {
+  // A single simulated round trip for the whole batch.
+  if (!simulate(false)) {
+    cb(false);
+    return;
+  }
+  LocalStorageBackend::putHeaders(entries, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::putBodies(
+    const std::map<std::string, HazelcastBodyEntry>& entries,
+    StorageCallback&& cb) {
+  if (!simulate(false)) {
+    cb(false);
+    return;
+  }
+  LocalStorageBackend::putBodies(entries, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::addRequestCount(
+    const uint64_t& hash_key, uint64_t misses, CountCallback&& cb) {
+  if (!simulate(false)) {
+    cb(0);
+    return;
+  }
+  LocalStorageBackend::addRequestCount(hash_key, misses, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::addInsertedBytes(int64_t window,
+    uint64_t bytes, CountCallback&& cb) {
+  if (!simulate(false)) {
+    cb(0);
+    return;
+  }
+  LocalStorageBackend::addInsertedBytes(window, bytes, std::move(cb));
+}
+
+void FaultInjectingStorageBackend::setFaults(const StorageFaults& faults) {
+  absl::MutexLock lock(&mutex_);
+  faults_ = faults;
+}
+
+bool FaultInjectingStorageBackend::simulate(bool read) {
+  uint64_t latency_us;
+  bool success = true;
+  {
+    absl::MutexLock lock(&mutex_);
+    latency_us = faults_.latency_us;
+    if (faults_.jitter_us != 0) {
+      latency_us += std::uniform_int_distribution<uint64_t>
+          (0, faults_.jitter_us)(random_);
+    }
+    double failure_rate = read ? faults_.read_failure_rate :
+        faults_.write_failure_rate;
+    if (failure_rate > 0) {
+      success = std::uniform_real_distribution<double>(0, 1)(random_) >=
+          failure_rate;
+    }
+  }
+  if (latency_us != 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+  }
+  return success;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <random>
+
+#include "absl/synchronization/mutex.h"
+#include "hazelcast_local_backend.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+// Faults injected into each operation of the backend.
+struct StorageFaults {
+  // Latency added to each operation.
+  uint32_t latency_us = 0;
+  // Upper bound of the uniformly distributed random latency added on
+  // top of latency_us.
+  uint32_t jitter_us = 0;
+  // Probability (0-1) of an operation to fail.
+  double read_failure_rate = 0;
+  double write_failure_rate = 0;
+};
+
+/**
+ * In-process storage backend injecting latency, jitter and failures.
+ *
+ * Intended for tests and benchmarks only: latency is spent sleeping on
+ * the calling thread before the callback is invoked, as a blocking
+ * round trip to a cluster would.
+ */
+class FaultInjectingStorageBackend : public LocalStorageBackend {
+public:
+  FaultInjectingStorageBackend(const StorageFaults& faults = StorageFaults(),
+      uint64_t seed = 0);
+
+  // LocalStorageBackend
+  void getHeader(const uint64_t& hash_key, HeaderLookupCallback&& cb) override;
+  void getBody(absl::string_view key, BodyLookupCallback&& cb) override;
+  void putHeader(const uint64_t& hash_key, const HazelcastHeaderEntry& entry,
+      StorageCallback&& cb) override;
+  void putBody(const std::string& key, const HazelcastBodyEntry& entry,
+      StorageCallback&& cb) override;
+  void removeBody(const std::string& key, StorageCallback&& cb) override;
+  void putHeaders(const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+      StorageCallback&& cb) override;
+  void putBodies(const std::map<std::string, HazelcastBodyEntry>& entries,
+      StorageCallback&& cb) override;
+  void addRequestCount(const uint64_t& hash_key, uint64_t misses,
+      CountCallback&& cb) override;
+  void addInsertedBytes(int64_t window, uint64_t bytes,
+      CountCallback&& cb) override;
+
+  // Replaces the injected faults at runtime.
+  void setFaults(const StorageFaults& faults);
+
+private:
+  // Sleeps for the configured latency and jitter, then decides if the
+  // operation fails with the configured read or write failure rate.
+  bool simulate(bool read);
+
+  absl::Mutex mutex_;
+  StorageFaults faults_ GUARDED_BY(mutex_);
+  std::mt19937_64 random_ GUARDED_BY(mutex_);
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Per thread free list of memory blocks for objects of type T.
+ *
+ * Objects created and destroyed for each request (e.g. lookup
+ * contexts) declare class specific operator new and delete using
+ * this list. A destroyed object leaves its block on the list of the
+ * destroying thread, and the next object created on that thread takes
+ * it instead of allocating. Each worker thread hence reuses the blocks
+ * of its previous requests without locking.
+ *
+ * At most MaxFreeBlocks blocks are kept per thread. They are freed when
+ * the thread exits. Blocks of other sizes (objects of derived types)
+ * are not pooled.
+ */
+template <typename T, size_t MaxFreeBlocks = 256>
+class HazelcastFreeList {
+public:
+  static void* allocate(size_t size) {
+    FreeBlocks& blocks = freeBlocks();
+    if (size != sizeof(T) || blocks.head == nullptr) {
+      return ::operator new(size);
+    }
+    Block* block = blocks.head;
+    blocks.head = block->next;
+    blocks.count--;
+    return block;
+  }
+
+  static void deallocate(void* ptr, size_t size) {
+    FreeBlocks& blocks = freeBlocks();
+    if (size != sizeof(T) || blocks.count >= MaxFreeBlocks) {
+      ::operator delete(ptr);
+      return;
+    }
+    Block* block = static_cast<Block*>(ptr);
+    block->next = blocks.head;
+    blocks.head = block;
+    blocks.count++;
+  }
+
+  // Number of blocks on the list of the calling thread.
+  static size_t freeCount() { return freeBlocks().count; }
+
+private:
+  static_assert(sizeof(T) >= sizeof(void*), "blocks keep the next pointer");
+
+  struct Block {
+    Block* next;
+  };
+
+  struct FreeBlocks {
+    Block* head = nullptr;
+    size_t count = 0;
+
+    ~FreeBlocks() {
+      while (head != nullptr) {
+        Block* next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  };
+
+  static FreeBlocks& freeBlocks() {
+    thread_local FreeBlocks blocks;
+    return blocks;
+  }
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
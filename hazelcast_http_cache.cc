@@ -2,7 +2,24 @@
 // Created by Enes Özcan on 13.01.2020.
 //
 #include "hazelcast_http_cache.h"
+#include "hazelcast_free_list.h"
+#include "hazelcast_local_backend.h"
+#include "hazelcast_remote_backend.h"
+#include "envoy/common/exception.h"
+#include "envoy/http/codes.h"
 #include "envoy/registry/registry.h"
+#include "common/common/utility.h"
+#include "common/tracing/http_tracer_impl.h"
+#include "extensions/filters/http/cache/http_cache_utils.h"
+#include "absl/container/fixed_array.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "openssl/sha.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -10,53 +27,386 @@ namespace HttpFilters {
 namespace Cache {
 namespace {
 
+// Updates the headers of a response whose body is served in the
+// stored encoding instead of the original one.
+void setEncodedHeaders(Http::HeaderMap& headers, HazelcastBodyCodec codec,
+    uint64_t encoded_size) {
+  headers.insertContentEncoding().value(
+      HazelcastBodyCodecs::encodingName(codec));
+  headers.insertContentLength().value(encoded_size);
+  if (!headers.Vary()) {
+    headers.insertVary().value(absl::string_view("Accept-Encoding"));
+  } else if (!absl::StrContains(absl::AsciiStrToLower(
+      headers.Vary()->value().getStringView()),
+      Http::Headers::get().AcceptEncoding.get())) {
+    Http::HeaderMapImpl::appendToHeader(headers.Vary()->value(),
+        "Accept-Encoding");
+  }
+  // The encoded representation is not byte identical to the original.
+  if (headers.Etag() &&
+      !absl::StartsWith(headers.Etag()->value().getStringView(), "W/")) {
+    headers.Etag()->value(absl::StrCat("W/",
+        headers.Etag()->value().getStringView()));
+  }
+}
+
+// Partition schedule of the inserts. Invalid schedules are rejected
+// rather than clamped, as they are likely configuration mistakes.
+HazelcastPartitionSchedule partitionScheduleOf(const HazelcastConfig& config) {
+  if (!config.has_partition_schedule()) {
+    if (config.body_partition_size() < 0) {
+      throw EnvoyException("hazelcast cache: negative body_partition_size");
+    }
+    return HazelcastPartitionSchedule::fixed(
+        config.body_partition_size() == 0 ?
+        HazelcastPartitionSchedule::DEFAULT_PARTITION_SIZE :
+        config.body_partition_size());
+  }
+  const PartitionSchedule& schedule = config.partition_schedule();
+  if (!HazelcastPartitionSchedule::valid(schedule.first_size(),
+      schedule.growth_factor(), schedule.max_size())) {
+    throw EnvoyException(absl::StrCat("hazelcast cache: invalid "
+        "partition_schedule (first_size ", schedule.first_size(),
+        ", growth_factor ", schedule.growth_factor(), ", max_size ",
+        schedule.max_size(), "): first_size must be positive, growth_factor "
+        "at least 1 and max_size not below first_size, or equal to it if "
+        "growth_factor is 1"));
+  }
+  return HazelcastPartitionSchedule(schedule.first_size(),
+      schedule.growth_factor(), schedule.max_size());
+}
+
+// Features the entries of the legacy format cannot record, hence which
+// readers before versioning would serve wrongly.
+void validateLegacyFormat(const HazelcastConfig& config) {
+  if (!config.legacy_entry_format()) {
+    return;
+  }
+  if (config.body_compression().codec() != BodyCompressionConfig::NONE ||
+      config.deduplicate_bodies() || config.has_partition_schedule()) {
+    throw EnvoyException("hazelcast cache: legacy_entry_format cannot be "
+        "combined with body_compression, deduplicate_bodies or "
+        "partition_schedule");
+  }
+}
+
+// Key of a deduplicated body partition: hex encoded SHA-256 of the
+// stored bytes. Cannot collide with the keys derived from hash keys,
+// which are shorter and decimal.
+std::string hexDigest(SHA256_CTX& context) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &context);
+  return absl::BytesToHexString(absl::string_view(
+      reinterpret_cast<const char*>(digest), SHA256_DIGEST_LENGTH));
+}
+
+std::string contentKey(const std::vector<hazelcast::byte>& partition) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, partition.data(), partition.size());
+  return hexDigest(context);
+}
+
+// Same key for a partition which is not linearized.
+std::string contentKey(const Buffer::Instance& partition) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  const uint64_t num_slices = partition.getRawSlices(nullptr, 0);
+  absl::FixedArray<Buffer::RawSlice> slices(num_slices);
+  partition.getRawSlices(slices.begin(), num_slices);
+  for (const Buffer::RawSlice& slice : slices) {
+    SHA256_Update(&context, slice.mem_, slice.len_);
+  }
+  return hexDigest(context);
+}
+
+// Freshness fields of a response, as LookupRequest::makeLookupResult
+// computes them on each lookup.
+HazelcastFreshness freshnessOf(const Http::HeaderMap& response_headers) {
+  static const Http::LowerCaseString last_modified("last-modified");
+  HazelcastFreshness freshness;
+  freshness.response_time = std::chrono::duration_cast<std::chrono::seconds>(
+      Utils::httpTime(response_headers.Date()).time_since_epoch()).count();
+  if (response_headers.CacheControl()) {
+    freshness.freshness_lifetime =
+        std::chrono::duration_cast<std::chrono::seconds>(
+            Utils::effectiveMaxAge(response_headers.CacheControl()->value()
+                .getStringView())).count();
+  }
+  if (response_headers.Etag()) {
+    freshness.etag = std::string(
+        response_headers.Etag()->value().getStringView());
+  }
+  if (response_headers.get(last_modified)) {
+    freshness.last_modified = std::string(
+        response_headers.get(last_modified)->value().getStringView());
+  }
+  if (response_headers.Vary()) {
+    for (absl::string_view name : absl::StrSplit(
+        response_headers.Vary()->value().getStringView(), ',',
+        absl::SkipWhitespace())) {
+      freshness.vary.push_back(
+          absl::AsciiStrToLower(absl::StripAsciiWhitespace(name)));
+    }
+  }
+  return freshness;
+}
+
+// Request header value as part of a variant key: lower case, without
+// whitespace, so that e.g. "gzip, br" and "gzip,br" select the same
+// variant.
+std::string normalizeVaryValue(absl::string_view value) {
+  std::string normalized;
+  normalized.reserve(value.size());
+  for (char c : value) {
+    if (!absl::ascii_isspace(c)) {
+      normalized.push_back(absl::ascii_tolower(c));
+    }
+  }
+  return normalized;
+}
+
+// Key of a body partition derived from the hash key: the hash key,
+// the infix and the partition index in decimal. Formatted into inline
+// storage and passed on as a view. The local backend looks it up as
+// is, while the remote one copies it into the std::string the client
+// map takes and serializes it for the round trip.
+class PartitionKey {
+public:
+  PartitionKey(uint64_t hash_key, uint64_t body_index) :
+      PartitionKey(hash_key, "", body_index) {}
+
+  PartitionKey(uint64_t hash_key, absl::string_view infix,
+      uint64_t body_index) {
+    ASSERT(infix.size() <= sizeof(data_) - 2 * MAX_DIGITS);
+    size_ = StringUtil::itoa(data_, MAX_DIGITS + 1, hash_key);
+    infix.copy(data_ + size_, infix.size());
+    size_ += infix.size();
+    size_ += StringUtil::itoa(data_ + size_, MAX_DIGITS + 1, body_index);
+  }
+
+  absl::string_view view() const { return absl::string_view(data_, size_); }
+  std::string str() const { return std::string(view()); }
+
+private:
+  static const size_t MAX_DIGITS = 20; // of a 64 bit integer.
+  char data_[64];
+  size_t size_;
+};
+
+// Infix of the partition keys of the identity representation of a
+// compressed body (see HazelcastRepresentation), unless deduplicated.
+const absl::string_view IDENTITY_INFIX = "-identity-";
+
+// Headers of a stale result, enough to revalidate the response.
+Http::HeaderMapPtr validatorHeaders(const HazelcastFreshness& freshness) {
+  static const Http::LowerCaseString last_modified("last-modified");
+  auto headers = std::make_unique<Http::HeaderMapImpl>();
+  if (!freshness.etag.empty()) {
+    headers->insertEtag().value(freshness.etag);
+  }
+  if (!freshness.last_modified.empty()) {
+    headers->addCopy(last_modified, freshness.last_modified);
+  }
+  return headers;
+}
+
 class HazelcastLookupContext : public LookupContext {
 
 public:
 
+  // headers is nullptr if the caller does not have them.
   explicit HazelcastLookupContext(HazelcastHttpCache& cache,
-      LookupRequest&& request) :
+      LookupRequest&& request, const Http::HeaderMap* headers,
+      SystemTime time, Tracing::Span& span) :
       hz_cache(cache),
       lookup_request(std::move(request)),
-      body_partition_size(cache.bodySizePerEntry()) {
+      request_time(time),
+      request_headers_supplied(headers != nullptr),
+      parent_span(span) {
     hash_key = stableHashKey(lookup_request.key());
+    entry_key = hash_key;
+    sampled = hz_cache.tracer().sampled();
+    static const Http::HeaderMapImpl no_headers;
+    const Http::HeaderMap& request_headers = headers ? *headers : no_headers;
+    if (request_headers.AcceptEncoding()) {
+      accept_encoding = std::string(
+          request_headers.AcceptEncoding()->value().getStringView());
+    }
+    head_request = request_headers.Method() &&
+        request_headers.Method()->value().getStringView() ==
+        Http::Headers::get().MethodValues.Head;
+    static const Http::LowerCaseString if_none_match_name("if-none-match");
+    static const Http::LowerCaseString if_modified_since_name(
+        "if-modified-since");
+    const Http::HeaderEntry* if_none_match =
+        request_headers.get(if_none_match_name);
+    if (if_none_match) {
+      this->if_none_match = std::string(if_none_match->value().getStringView());
+    }
+    const Http::HeaderEntry* if_modified_since =
+        request_headers.get(if_modified_since_name);
+    if (if_modified_since) {
+      this->if_modified_since = Utils::httpTime(if_modified_since);
+    }
+    // Values the response may vary on. Others are not needed since
+    // such responses are not cached.
+    for (const Http::LowerCaseString& name : hz_cache.allowedVaryHeaders()) {
+      const Http::HeaderEntry* header = request_headers.get(name);
+      if (header) {
+        vary_values.emplace_back(name.get(),
+            normalizeVaryValue(header->value().getStringView()));
+      }
+    }
   }
 
   // Current response's hash key.
   // The key is used when storing header entries.
   inline const uint64_t& getHashKey() { return hash_key; }
 
-  void getHeaders(LookupHeadersCallback&& cb) override {
-    HazelcastHeaderPtr header_entry = hz_cache.lookupHeader(hash_key);
-    if (header_entry) {
-      this->total_body_size = std::move(header_entry->total_body_size);
-      cb(lookup_request.makeLookupResult
-        (std::move(header_entry->header_map_ptr), total_body_size));
-    } else {
-      cb(LookupResult{});
+  // Hash key of the variant of the response selected by this request,
+  // for a response varying on the given request headers.
+  uint64_t variantKey(const std::vector<std::string>& vary) const {
+    Key key = lookup_request.key();
+    for (const std::string& name : vary) {
+      auto value = std::find_if(vary_values.begin(), vary_values.end(),
+          [&name](const std::pair<std::string, std::string>& vary_value) {
+        return vary_value.first == name;
+      });
+      // A missing header is a value of its own.
+      key.add_custom_fields(value == vary_values.end() ? name :
+          absl::StrCat(name, "=", value->second));
     }
+    return stableHashKey(key);
+  }
+
+  // Span and sampling decision are passed to the insert
+  // context created from this lookup.
+  inline Tracing::Span& getParentSpan() { return parent_span; }
+  inline bool isSampled() { return sampled; }
+
+  // False if the lookup was made without the request headers. Then
+  // the variant of a response with Vary is unknown.
+  inline bool requestHeadersSupplied() const {
+    return request_headers_supplied;
+  }
+
+  void getHeaders(LookupHeadersCallback&& cb) override {
+    lookupHeaderEntry(hash_key, [this, cb = std::move(cb)]
+        (HazelcastHeaderPtr&& header_entry) mutable {
+      if (header_entry && !header_entry->vary_spec.empty()) {
+        if (!request_headers_supplied) {
+          // The variant of this request is unknown, any other would
+          // be a wrong response.
+          onHeaderEntry(nullptr, cb);
+          return;
+        }
+        // The response varies. Variants are stored under the keys of
+        // the request header values.
+        entry_key = variantKey(header_entry->vary_spec);
+        lookupHeaderEntry(entry_key, [this, cb = std::move(cb)]
+            (HazelcastHeaderPtr&& variant_entry) {
+          if (variant_entry && !variant_entry->vary_spec.empty()) {
+            variant_entry.reset(); // not a response
+          }
+          onHeaderEntry(std::move(variant_entry), cb);
+        });
+        return;
+      }
+      onHeaderEntry(std::move(header_entry), cb);
+    });
   }
 
   // Hence bodies are stored partially on the cache
   // (see hazelcast_cache_entry.h for details), the
   // returning buffer from this function can have a
-  // size of at most body_partition_size. Caller
+  // size of at most one partition. Caller
   // (filter) has to check range and make another
   // getBody request if needed.
+  //
+  // Compressed partitions are decompressed unless the client accepts
+  // the stored encoding. Then the range is over the encoded body.
   void getBody(const AdjustedByteRange& range,
       LookupBodyCallback&& cb) override {
     ASSERT(range.end() <= total_body_size);
-    uint64_t body_index = range.begin() / body_partition_size;
-    HazelcastBodyPtr body = hz_cache.lookupBody
-        (std::to_string(hash_key) + std::to_string(body_index));
-    if (body) {
-        uint64_t start = (range.begin() % body_partition_size);
+    ASSERT(!body_cb);
+    body_begin = range.begin();
+    body_end = range.end();
+    body_cb = std::move(cb);
+    body_index = serve_encoded ?
+        std::upper_bound(encoded_partition_ends.begin(),
+            encoded_partition_ends.end(), range.begin()) -
+            encoded_partition_ends.begin() :
+        schedule.indexOf(range.begin());
+    const PartitionKey derived_key = identity ?
+        PartitionKey(entry_key, IDENTITY_INFIX, body_index) :
+        PartitionKey(entry_key, body_index);
+    const absl::string_view body_key = !partition_keys.empty() ?
+        absl::string_view(partition_keys[body_index]) : derived_key.view();
+    body_span = HazelcastCacheTracer::spawn(parent_span,
+        HazelcastCacheTracer::LOOKUP_BODY,
+        sampled && hz_cache.tracer().traceBodyPartitions());
+    if (body_span) {
+      body_span->setTag(HazelcastCacheTracer::TAG_PARTITION_INDEX,
+          body_index);
+      body_span->setTag(HazelcastCacheTracer::TAG_MEMBER_ADDRESS,
+          hz_cache.backend().bodyOwnerAddress(std::string(body_key)));
+    }
+    // State of the lookup is kept in the context, so that the callback
+    // fits into std::function without allocating.
+    hz_cache.lookupBody(body_key, [this](HazelcastBodyPtr&& body) {
+      onBody(std::move(body));
+    });
+  };
+
+  // Trailers are read with the header entry, hence no round trip.
+  void getTrailers(LookupTrailersCallback&& cb) override {
+    cb(std::move(trailers));
+  };
+
+  // Class specific allocation, see hazelcast_free_list.h
+  static void* operator new(size_t size) {
+    return HazelcastFreeList<HazelcastLookupContext>::allocate(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    HazelcastFreeList<HazelcastLookupContext>::deallocate(ptr, size);
+  }
+
+private:
+
+  void onBody(HazelcastBodyPtr&& body) {
+    LookupBodyCallback cb = std::move(body_cb);
+    body_cb = nullptr;
+    if (body_span) {
+      body_span->setTag(HazelcastCacheTracer::TAG_BYTES,
+          body ? body->body_buffer_.size() : 0);
+      if (!body) body_span->setError();
+      body_span->finish();
+      body_span.reset();
+    }
+    if (body && body_codec != HazelcastBodyCodec::None && !serve_encoded) {
+        Buffer::OwnedImpl decoded;
+        if (!HazelcastBodyCodecs::decompress(body_codec, body->body_buffer_,
+            body_index, decoded)) {
+          cb(nullptr); // abort lookup
+          return;
+        }
+        decoded.drain(body_begin - schedule.begin(body_index));
+        auto data = std::make_unique<Buffer::OwnedImpl>();
+        if (body_end < schedule.begin(body_index + 1)) {
+          data->move(decoded, body_end - body_begin);
+        } else {
+          data->move(decoded);
+        }
+        cb(std::move(data));
+    } else if (body) {
+        uint64_t start = body_begin - partitionBegin(body_index);
         hazelcast::byte* data = body->body_buffer_.data() + start;
-        if (range.end() < (body_index + 1) * body_partition_size){
+        if (body_end < partitionBegin(body_index + 1)){
           // No other chunk is needed since one chunk satisfies
           // the range. Copy only needed bytes.
           cb(std::make_unique<Buffer::OwnedImpl>(data,
-              range.end() % body_partition_size));
+              body_end - body_begin));
         } else {
           // Another body chunk is needed. Hence copy all
           // the bytes until the end of the buffer.
@@ -67,21 +417,209 @@ public:
         // Body is expected to reside in the cache but lookup is failed.
         cb(nullptr); // abort lookup
     }
-  };
+  }
 
-  void getTrailers(LookupTrailersCallback&& cb) override {
-    // TODO: not supported by the filter yet.
-    cb(nullptr); 
-  };
+  void lookupHeaderEntry(uint64_t key, HeaderLookupCallback&& cb) {
+    HazelcastCacheSpanPtr span = HazelcastCacheTracer::spawn(parent_span,
+        HazelcastCacheTracer::LOOKUP_HEADER, sampled);
+    hz_cache.lookupHeader(key, [this, key, span, cb = std::move(cb)]
+        (HazelcastHeaderPtr&& header_entry) {
+      if (span) {
+        span->setTag(HazelcastCacheTracer::TAG_HASH_KEY, key);
+        span->setTag(HazelcastCacheTracer::TAG_MEMBER_ADDRESS,
+            hz_cache.backend().headerOwnerAddress(key));
+        if (header_entry) {
+          span->setTag(HazelcastCacheTracer::TAG_BODY_SIZE,
+              header_entry->total_body_size);
+        }
+        span->finish();
+      }
+      cb(std::move(header_entry));
+    });
+  }
 
-private:
+  void onHeaderEntry(HazelcastHeaderPtr&& header_entry,
+      const LookupHeadersCallback& cb) {
+    if (header_entry && header_entry->freshness &&
+        requiresValidation(*header_entry->freshness)) {
+      // Stale. Only the validators are needed for a conditional
+      // request, hence the stored headers are not built.
+      LookupResult result;
+      result.cache_entry_status_ = CacheEntryStatus::RequiresValidation;
+      result.headers_ = validatorHeaders(*header_entry->freshness);
+      result.content_length_ = header_entry->total_body_size;
+      result.has_trailers_ = header_entry->hasTrailers();
+      cb(std::move(result));
+      return;
+    }
+    if (header_entry) {
+      this->total_body_size = std::move(header_entry->total_body_size);
+      body_codec = header_entry->body_codec;
+      schedule = hz_cache.entrySchedule(*header_entry);
+      partition_keys = std::move(header_entry->partition_keys);
+      trailers = header_entry->trailers();
+      const bool accepts_codec = !lookup_request.isRangeRequest() &&
+          HazelcastBodyCodecs::accepts(accept_encoding, body_codec);
+      if (body_codec != HazelcastBodyCodec::None && !accepts_codec) {
+        for (HazelcastRepresentation& representation :
+            header_entry->representations) {
+          if (representation.codec == HazelcastBodyCodec::None) {
+            // Stored uncompressed too, no need to decompress.
+            body_codec = HazelcastBodyCodec::None;
+            identity = true;
+            partition_keys = std::move(representation.partition_keys);
+            break;
+          }
+        }
+      }
+      if (body_codec != HazelcastBodyCodec::None && accepts_codec) {
+        // Client accepts the stored encoding, no need to decompress.
+        serve_encoded = true;
+        uint64_t encoded_size = 0;
+        for (const uint64_t& size : header_entry->encoded_partition_sizes) {
+          encoded_size += size;
+          encoded_partition_ends.push_back(encoded_size);
+        }
+        setEncodedHeaders(header_entry->headerMap(), body_codec,
+            encoded_size);
+        this->total_body_size = encoded_size;
+      }
+      // Method and conditions are only known if the request headers
+      // were supplied. Otherwise the full response is served, leaving
+      // HEAD and conditional requests to the filter.
+      if (request_headers_supplied && header_entry->freshness &&
+          (head_request || notModified(*header_entry))) {
+        // No body is needed, hence none is fetched regardless of the
+        // number of partitions.
+        LookupResult result;
+        result.cache_entry_status_ = CacheEntryStatus::Ok;
+        result.headers_ = header_entry->releaseHeaderMap();
+        result.content_length_ = 0;
+        // Nor are the trailers, which end the body.
+        result.has_trailers_ = false;
+        if (!head_request) {
+          // The filter serves an Ok result as it is, hence the 304 is
+          // built here.
+          result.headers_->setStatus(enumToInt(Http::Code::NotModified));
+          result.headers_->removeContentLength();
+        }
+        cb(std::move(result));
+        return;
+      }
+      if (header_entry->freshness && !lookup_request.isRangeRequest()) {
+        // Fresh, as LookupRequest::makeLookupResult would decide
+        // by parsing the headers.
+        LookupResult result;
+        result.cache_entry_status_ = CacheEntryStatus::Ok;
+        result.headers_ = header_entry->releaseHeaderMap();
+        result.content_length_ = total_body_size;
+        result.has_trailers_ = header_entry->hasTrailers();
+        cb(std::move(result));
+        return;
+      }
+      LookupResult result = lookup_request.makeLookupResult(
+          header_entry->releaseHeaderMap(), total_body_size);
+      // Not known to makeLookupResult, which leaves it unset.
+      result.has_trailers_ = header_entry->hasTrailers();
+      cb(std::move(result));
+    } else {
+      cb(LookupResult{});
+    }
+  }
+
+  // True if the validators of a fresh response match the conditional
+  // request (RFC 7232 section 6). If-Modified-Since is ignored if
+  // If-None-Match is given.
+  bool notModified(HazelcastHeaderEntry& header_entry) {
+    const HazelcastFreshness& freshness = *header_entry.freshness;
+    if (!if_none_match.empty()) {
+      if (freshness.etag.empty()) {
+        return false;
+      }
+      // Weak comparison: the W/ prefix is ignored.
+      const absl::string_view etag = absl::StripPrefix(freshness.etag, "W/");
+      for (absl::string_view tag : absl::StrSplit(if_none_match, ',')) {
+        tag = absl::StripAsciiWhitespace(tag);
+        if (tag == "*" || absl::StripPrefix(tag, "W/") == etag) {
+          return true;
+        }
+      }
+      return false;
+    }
+    if (if_modified_since && *if_modified_since != SystemTime() &&
+        !freshness.last_modified.empty()) {
+      // Parsed from the header map, which is served either way.
+      static const Http::LowerCaseString last_modified_name("last-modified");
+      const SystemTime modified = Utils::httpTime(
+          header_entry.headerMap().get(last_modified_name));
+      return modified != SystemTime() && modified <= *if_modified_since;
+    }
+    return false;
+  }
+
+  bool requiresValidation(const HazelcastFreshness& freshness) {
+    if (freshness.freshness_lifetime < 0) {
+      return true;
+    }
+    const SystemTime response_time{
+        std::chrono::seconds(freshness.response_time)};
+    return request_time - response_time >
+        std::chrono::seconds(freshness.freshness_lifetime);
+  }
+
+  // Offset of the partition in the served body.
+  uint64_t partitionBegin(uint64_t body_index) {
+    if (!serve_encoded) {
+      return schedule.begin(body_index);
+    }
+    return body_index == 0 ? 0 : body_index > encoded_partition_ends.size() ?
+        total_body_size : encoded_partition_ends[body_index - 1];
+  }
 
   HazelcastHttpCache& hz_cache;
   const LookupRequest lookup_request;
+  const SystemTime request_time;
+  const bool request_headers_supplied;
 
   uint64_t total_body_size; // of the current response.
   uint64_t hash_key; // of the current response.
-  const uint64_t& body_partition_size; // max body size per cache entry.
+  // Key of the header entry found, differs from hash_key for variants
+  // of a response with Vary. Body keys are derived from it.
+  uint64_t entry_key;
+  // Partition sizes of the current response.
+  HazelcastPartitionSchedule schedule;
+
+  Tracing::Span& parent_span;
+  bool sampled;
+
+  // Accept-Encoding of the request, empty if not given.
+  std::string accept_encoding;
+  HazelcastBodyCodec body_codec = HazelcastBodyCodec::None;
+  // True if the body is served in the stored encoding. Then
+  // partition offsets are looked up from encoded_partition_ends.
+  bool serve_encoded = false;
+  std::vector<uint64_t> encoded_partition_ends;
+  // Keys of the deduplicated partitions, empty otherwise.
+  std::vector<std::string> partition_keys;
+  // True if the identity representation of a compressed body is
+  // served.
+  bool identity = false;
+  // Conditions of the request. The body is not fetched if the request
+  // is HEAD or the stored response is not modified.
+  bool head_request;
+  std::string if_none_match;
+  absl::optional<SystemTime> if_modified_since;
+  // Normalized values of the request headers in allowedVaryHeaders.
+  std::vector<std::pair<std::string, std::string>> vary_values;
+  // Trailers of the current response, nullptr if it has none.
+  Http::HeaderMapPtr trailers;
+
+  // State of the pending getBody.
+  uint64_t body_begin = 0;
+  uint64_t body_end = 0;
+  uint64_t body_index = 0;
+  HazelcastCacheSpanPtr body_span;
+  LookupBodyCallback body_cb;
 
 };
 
@@ -89,18 +627,76 @@ class HazelcastInsertContext : public InsertContext {
 
 public:
 
-  HazelcastInsertContext(LookupContext& lookup_context,
+  HazelcastInsertContext(LookupContextPtr&& lookup_context,
       HazelcastHttpCache& cache) : hz_cache(cache),
       hash_key(dynamic_cast<HazelcastLookupContext&>
-      (lookup_context).getHashKey()),
-      body_partition_size(cache.bodySizePerEntry()) {
-    available_buffer_bytes = body_partition_size;
+      (*lookup_context).getHashKey()),
+      header_key(hash_key),
+      schedule(cache.partitionSchedule()),
+      parent_span(dynamic_cast<HazelcastLookupContext&>
+      (*lookup_context).getParentSpan()),
+      sampled(dynamic_cast<HazelcastLookupContext&>
+      (*lookup_context).isSampled()),
+      lookup(std::move(lookup_context)) {
+    header.setLegacyFormat(hz_cache.legacyEntryFormat());
+    available_buffer_bytes = schedule.size(0);
+    if (hz_cache.writeBehind()) {
+      pending = std::make_unique<HazelcastPendingInsert>();
+      pending->content_keys = hz_cache.deduplicateBodies();
+    }
+    // Nothing is stored for keys not missed often enough yet.
+    hz_cache.admitInsert(hash_key, [this](bool admitted) {
+      if (!admitted) aborted = true;
+    });
   };
 
+  ~HazelcastInsertContext() {
+    if (staged) {
+      // The response did not complete.
+      hz_cache.bufferPool().release(std::move(staging));
+    }
+    releaseReserved();
+  }
+
   void insertHeaders(const Http::HeaderMap& response_headers,
       bool end_stream) override {
-    header.header_map_ptr =
-        std::make_unique<Http::HeaderMapImpl>(response_headers);
+    if (aborted) {
+      return;
+    }
+    uint64_t content_length;
+    if (hz_cache.maxObjectSize() > 0 && response_headers.ContentLength() &&
+        absl::SimpleAtoi(response_headers.ContentLength()->value()
+            .getStringView(), &content_length) &&
+        content_length > hz_cache.maxObjectSize()) {
+      // Not started, hence nothing to clean up.
+      hz_cache.insertStats().record(HazelcastInsertSkip::TooLarge);
+      aborted = true;
+      return;
+    }
+    header.freshness = freshnessOf(response_headers);
+    if (!header.freshness->vary.empty()) {
+      if (hz_cache.legacyEntryFormat()) {
+        // Readers before versioning do not know Vary specs.
+        hz_cache.insertStats().record(HazelcastInsertSkip::LegacyFormat);
+        aborted = true;
+        return;
+      }
+      if (!hz_cache.varyAllowed(header.freshness->vary) ||
+          !dynamic_cast<HazelcastLookupContext&>(*lookup)
+              .requestHeadersSupplied()) {
+        // Not cached, as is a response whose variant is unknown since
+        // the lookup had no request headers. Nothing is stored and the
+        // body is not buffered.
+        aborted = true;
+        return;
+      }
+      // Stored as the variant of the request, see flushHeader.
+      header_key = dynamic_cast<HazelcastLookupContext&>(*lookup)
+          .variantKey(header.freshness->vary);
+    }
+    // Encoded once here, the map is not copied.
+    header.setHeaders(response_headers);
+    body_codec = hz_cache.codecs().codecFor(response_headers);
     if (end_stream) {
       flushHeader();
     }
@@ -108,126 +704,524 @@ public:
 
   void insertBody(const Buffer::Instance& chunk,
       InsertCallback ready_for_next_chunk, bool end_stream) override {
-    uint64_t remaining_chunk_size = chunk.length();
-    uint64_t local_chunk_index = 0;
-    // Insert bodies in a contiguous manner
-    // using body_buffer.
-    while (remaining_chunk_size) {
-      ASSERT(local_chunk_index <= chunk.length());
-      ASSERT(remaining_chunk_size > 0);
-      if (available_buffer_bytes <= remaining_chunk_size) {
-        // This chunk is going to fill the buffer, So partition is needed.
-        copyIntoLocalBuffer(local_chunk_index, available_buffer_bytes, chunk);
-        ASSERT(buffer_vector.size() == body_partition_size);
-        remaining_chunk_size -= available_buffer_bytes;
-        available_buffer_bytes = 0;
-        flushBuffer();
-        // TODO: Disabled for the tests temporarily:
-        //if (ready_for_next_chunk) ready_for_next_chunk(false);
-      } else {
-        // end of the current chunk's insertion
-        copyIntoLocalBuffer(local_chunk_index, remaining_chunk_size, chunk);
-        available_buffer_bytes -= remaining_chunk_size;
-        remaining_chunk_size = 0;
+    if (aborted) {
+      // A partition could not be stored before. The response will
+      // not be served from the cache, hence no need to continue.
+      if (ready_for_next_chunk) ready_for_next_chunk(false);
+      return;
+    }
+    if (exceedsMaxObjectSize(chunk.length())) {
+      abortInsert(HazelcastInsertSkip::AbortedTooLarge);
+      if (ready_for_next_chunk) ready_for_next_chunk(false);
+      return;
+    }
+    // Insert bodies in a contiguous manner using partition_buffer.
+    const uint64_t num_slices = chunk.getRawSlices(nullptr, 0);
+    absl::FixedArray<Buffer::RawSlice> slices(num_slices);
+    chunk.getRawSlices(slices.begin(), num_slices);
+    for (const Buffer::RawSlice& slice : slices) {
+      const uint8_t* data = static_cast<const uint8_t*>(slice.mem_);
+      uint64_t remaining_slice_size = slice.len_;
+      while (remaining_slice_size) {
+        const uint64_t size =
+            std::min(remaining_slice_size, available_buffer_bytes);
+        if (!reserveStaging(size)) {
+          // Refused if nothing is staged or written yet.
+          abortInsert(total_body_size + bufferedBytes() == 0 ?
+              HazelcastInsertSkip::MemoryBudget :
+              HazelcastInsertSkip::AbortedMemoryBudget);
+          if (ready_for_next_chunk) ready_for_next_chunk(false);
+          return;
+        }
+        append(data, size);
+        data += size;
+        remaining_slice_size -= size;
+        available_buffer_bytes -= size;
+        if (available_buffer_bytes == 0) {
+          // This chunk filled the buffer, so a partition is needed.
+          ASSERT(bufferedBytes() == schedule.size(body_order));
+          flushBuffer(false);
+          if (aborted) {
+            if (ready_for_next_chunk) ready_for_next_chunk(false);
+            return;
+          }
+          // TODO: Disabled for the tests temporarily:
+          //if (ready_for_next_chunk) ready_for_next_chunk(false);
+        }
       }
     }
-    
+
     if (end_stream) {
       // Header shouldn't be inserted before bodies to
       // ensure the total body size for this request.
-      flushBuffer();
+      flushBuffer(true);
       flushHeader();
     }
-    if (ready_for_next_chunk) ready_for_next_chunk(true);
+    if (ready_for_next_chunk) ready_for_next_chunk(!aborted);
   }
 
-  void insertTrailers(const Http::HeaderMap&) override {
-    // TODO: Not supported by the filter yet.
-    ASSERT(false);
+  // Trailers end the response. They are stored in the header entry,
+  // hence committed together with it.
+  void insertTrailers(const Http::HeaderMap& trailers) override {
+    if (aborted) {
+      return;
+    }
+    if (hz_cache.legacyEntryFormat()) {
+      // Readers before versioning would serve the response without
+      // them.
+      abortInsert(HazelcastInsertSkip::LegacyFormat);
+      return;
+    }
+    header.setTrailers(trailers);
+    if (body_order > 0 || bufferedBytes() > 0) {
+      // The body ended without end_stream.
+      flushBuffer(true);
+    }
+    flushHeader();
   };
 
 private:
 
-  void copyIntoLocalBuffer(uint64_t& index, uint64_t& size,
-      const Buffer::Instance& source){
-    uint64_t buffer_size = body_partition_size - available_buffer_bytes;
-    buffer_vector.resize(buffer_vector.size() + size);
-    source.copyOut(index, size, buffer_vector.data() + buffer_size);
-    index += size;
-  };
+  // Appends bytes of the current partition. The partition is staged in
+  // a pooled buffer if the pool is enabled, in partition_buffer
+  // otherwise.
+  void append(const uint8_t* data, uint64_t size) {
+    if (!staged && hz_cache.bufferPool().pooled(schedule.size(body_order))) {
+      staging = hz_cache.bufferPool().acquire(schedule.size(body_order));
+      staged = true;
+    }
+    if (staged) {
+      staging.insert(staging.end(), data, data + size);
+    } else {
+      partition_buffer.add(data, size);
+    }
+  }
+
+  uint64_t bufferedBytes() const {
+    return staged ? staging.size() : partition_buffer.length();
+  }
+
+  // True if the body would exceed max_object_size with the given bytes.
+  bool exceedsMaxObjectSize(uint64_t size) const {
+    const uint64_t max_size = hz_cache.maxObjectSize();
+    return max_size > 0 && total_body_size + bufferedBytes() + size > max_size;
+  }
+
+  // Reserves the memory taken by staging size more bytes. A pooled
+  // buffer is acquired at the size of its partition, hence reserved
+  // whole once the partition starts.
+  bool reserveStaging(uint64_t size) {
+    if (staged) {
+      return true;
+    }
+    if (bufferedBytes() == 0 &&
+        hz_cache.bufferPool().pooled(schedule.size(body_order))) {
+      return reserve(schedule.size(body_order));
+    }
+    return reserve(size);
+  }
+
+  // Reserves bytes on the memory budget of the cache.
+  bool reserve(uint64_t size) {
+    if (!hz_cache.memoryBudget().tryReserve(size)) {
+      return false;
+    }
+    reserved_bytes += size;
+    return true;
+  }
 
-  void flushBuffer(){
-    uint64_t buffer_size = body_partition_size - available_buffer_bytes;
+  void releaseReserved() {
+    hz_cache.memoryBudget().release(reserved_bytes);
+    reserved_bytes = 0;
+  }
+
+  // Drops the buffered bytes and removes the partitions written so far.
+  // Deduplicated partitions may be referenced by other responses, hence
+  // they are left to expire.
+  void abortInsert(HazelcastInsertSkip reason) {
+    aborted = true;
+    hz_cache.insertStats().record(reason);
+    if (staged) {
+      hz_cache.bufferPool().release(std::move(staging));
+      staging.clear();
+      staged = false;
+    }
+    partition_buffer.drain(partition_buffer.length());
+    // Nothing is written yet in write-behind mode.
+    pending.reset();
+    for (const std::string& key : written_keys) {
+      hz_cache.backend().removeBody(key, [](bool) {});
+    }
+    written_keys.clear();
+    releaseReserved();
+  }
+
+  // last is set for the final partition of the body.
+  void flushBuffer(bool last){
+    if (staged) {
+      // Not copied, the buffer returns to the pool once the partition
+      // is serialized.
+      hz_cache.bufferPool().addFragment(std::move(staging), partition_buffer);
+      staging.clear();
+      staged = false;
+    }
+    const uint64_t buffer_size = partition_buffer.length();
     HazelcastBodyEntry bodyEntry;
+    bodyEntry.setLegacyFormat(hz_cache.legacyEntryFormat());
     total_body_size += buffer_size;
-    bodyEntry.body_buffer_ = std::move(buffer_vector);
-    buffer_vector.clear();
-    hz_cache.insertBody(std::to_string(hash_key) + std::to_string(body_order++),
-        bodyEntry);
-    available_buffer_bytes = body_partition_size; // Reset buffer index
+    if (body_codec != HazelcastBodyCodec::None) {
+      if (body_order == 0 && last &&
+          buffer_size < hz_cache.codecs().minSize()) {
+        // The whole body is in this partition and too small to compress.
+        body_codec = HazelcastBodyCodec::None;
+      } else {
+        if (!compressor) {
+          compressor = std::make_unique<HazelcastBodyCompressor>(body_codec);
+        }
+        compressor->compress(partition_buffer, bodyEntry.body_buffer_, last);
+        header.encoded_partition_sizes.push_back(
+            bodyEntry.body_buffer_.size());
+        if (hz_cache.codecs().storeIdentity()) {
+          insertIdentityPartition();
+        }
+        partition_buffer.drain(partition_buffer.length());
+      }
+    }
+    std::string body_key;
+    if (hz_cache.deduplicateBodies()) {
+      // Identical partitions of different responses share the same key,
+      // hence stored once. Writing it again renews its lifetime.
+      body_key = body_codec == HazelcastBodyCodec::None ?
+          contentKey(partition_buffer) : contentKey(bodyEntry.body_buffer_);
+      header.partition_keys.push_back(body_key);
+    } else {
+      body_key = PartitionKey(header_key, body_order).str();
+    }
+    if (body_codec == HazelcastBodyCodec::None) {
+      // Serialized from the slices of the buffer, not copied again.
+      bodyEntry.setBody(partition_buffer);
+    }
+    insertPartition(body_key, bodyEntry, buffer_size);
+    body_order++;
+    // Reset buffer index for the next partition.
+    available_buffer_bytes = schedule.size(body_order);
+    if (!pending) {
+      // Written, the staged bytes are freed with the entry. Partitions
+      // of a pending insert stay reserved until they are written.
+      releaseReserved();
+    }
+  }
+
+  // Stores the uncompressed current partition besides the compressed
+  // one. See HazelcastRepresentation.
+  void insertIdentityPartition() {
+    const uint64_t size = partition_buffer.length();
+    std::string body_key;
+    if (hz_cache.deduplicateBodies()) {
+      body_key = contentKey(partition_buffer);
+      identity.partition_keys.push_back(body_key);
+    } else {
+      body_key = PartitionKey(header_key, IDENTITY_INFIX, body_order).str();
+    }
+    identity.partition_sizes.push_back(size);
+    HazelcastBodyEntry partition;
+    partition.setBody(partition_buffer);
+    insertPartition(body_key, partition, size);
+  }
+
+  // A failed write aborts the insert. In write-behind mode the
+  // partition is moved to the pending insert instead, unless the
+  // response cannot be queued anymore.
+  void insertPartition(const std::string& body_key,
+      HazelcastBodyEntry& partition, uint64_t size) {
+    if (aborted) {
+      return;
+    }
+    if (pending) {
+      // Rate limited by the queue, see HazelcastWriteBehindQueue.
+      pending->bytes += partition.size();
+      pending->partitions.emplace_back(body_key, std::move(partition));
+      if (pending->bytes > hz_cache.writeBehind()->maxQueuedBytes()) {
+        abortInsert(HazelcastInsertSkip::QueueLimit);
+      }
+      return;
+    }
+    // Limited on the stored bytes, i.e. compressed.
+    hz_cache.limitInsert(partition.size(), [this](bool allowed) {
+      if (!allowed) {
+        abortInsert(partitions_inserted == 0 ?
+            HazelcastInsertSkip::RateLimited :
+            HazelcastInsertSkip::AbortedRateLimited);
+      }
+    });
+    if (aborted) {
+      return;
+    }
+    partitions_inserted++;
+    if (!hz_cache.deduplicateBodies()) {
+      written_keys.push_back(body_key);
+    }
+    HazelcastCacheSpanPtr span = HazelcastCacheTracer::spawn(parent_span,
+        HazelcastCacheTracer::INSERT_BODY,
+        sampled && hz_cache.tracer().traceBodyPartitions());
+    if (span) {
+      span->setTag(HazelcastCacheTracer::TAG_PARTITION_INDEX, body_order);
+      span->setTag(HazelcastCacheTracer::TAG_BYTES, size);
+      span->setTag(HazelcastCacheTracer::TAG_MEMBER_ADDRESS,
+          hz_cache.backend().bodyOwnerAddress(body_key));
+    }
+    hz_cache.insertBody(body_key, partition, [this, span](bool success) {
+      if (!success) {
+        aborted = true;
+        if (span) span->setError();
+      }
+      if (span) span->finish();
+    });
   }
 
   void flushHeader(){
+    if (aborted) {
+      // Header is not inserted if any of the partitions is
+      // missing. Otherwise lookups would find an incomplete
+      // body.
+      return;
+    }
     header.total_body_size = total_body_size;
-    hz_cache.insertHeader(hash_key, header);
+    header.partition_schedule = schedule;
+    // A response without body is never compressed.
+    header.body_codec = header.encoded_partition_sizes.empty() ?
+        HazelcastBodyCodec::None : body_codec;
+    if (header.body_codec != HazelcastBodyCodec::None &&
+        !identity.partition_sizes.empty()) {
+      header.representations.push_back(identity);
+    }
+    if (pending) {
+      // Committed by the write-behind queue once the partitions are
+      // stored.
+      pending->headers.emplace_back(header_key, header);
+      if (header_key != hash_key) {
+        pending->headers.emplace_back(hash_key, varySpec());
+      }
+      // The queue holds the reservation until the response is written
+      // or dropped.
+      pending->reserved_bytes = reserved_bytes;
+      reserved_bytes = 0;
+      hz_cache.writeBehind()->push(std::move(pending));
+      return;
+    }
+    HazelcastCacheSpanPtr span = HazelcastCacheTracer::spawn(parent_span,
+        HazelcastCacheTracer::INSERT_HEADER, sampled);
+    if (span) {
+      span->setTag(HazelcastCacheTracer::TAG_HASH_KEY, header_key);
+      span->setTag(HazelcastCacheTracer::TAG_BODY_SIZE, total_body_size);
+      span->setTag(HazelcastCacheTracer::TAG_MEMBER_ADDRESS,
+          hz_cache.backend().headerOwnerAddress(header_key));
+    }
+    hz_cache.insertHeader(header_key, header, [span](bool success) {
+      if (span) {
+        if (!success) span->setError();
+        span->finish();
+      }
+    });
+    if (header_key != hash_key) {
+      // Vary spec, written after the variant so that a lookup finding
+      // the spec finds the variant too.
+      hz_cache.insertHeader(hash_key, varySpec(), [](bool) {});
+    }
+  }
+
+  HazelcastHeaderEntry varySpec() const {
+    HazelcastHeaderEntry vary_spec;
+    vary_spec.total_body_size = 0;
+    vary_spec.vary_spec = header.freshness->vary;
+    return vary_spec;
   }
 
   HazelcastHttpCache& hz_cache;
   HazelcastHeaderEntry header;
   int body_order = 0;
   const uint64_t hash_key;
-  const uint64_t& body_partition_size;
+  // Key of the stored header entry. Differs from hash_key if the
+  // response varies, then the body keys are derived from it as well.
+  uint64_t header_key;
+  const HazelcastPartitionSchedule& schedule;
   uint64_t available_buffer_bytes;
   uint64_t total_body_size = 0;
+  // Partitions passed to the storage, including identity copies.
+  uint64_t partitions_inserted = 0;
+
+  // Set when a partition cannot be stored or the response is not
+  // admitted.
+  bool aborted = false;
+
+  // Codec of the partitions, decided on the response headers.
+  HazelcastBodyCodec body_codec = HazelcastBodyCodec::None;
+  HazelcastBodyCompressorPtr compressor;
+  // Uncompressed partitions, if stored besides the compressed ones.
+  HazelcastRepresentation identity;
+
+  Tracing::Span& parent_span;
+  const bool sampled;
 
   // Since bodies are partially stored in the cache,
   // they have to be inserted contiguous. This buffer
   // is used to store bytes coming from filter and
-  // flushed when it is full.
-  std::vector<hazelcast::byte> buffer_vector;
+  // flushed when it is full. Bytes are appended to its
+  // slices, hence never moved while the partition fills.
+  Buffer::OwnedImpl partition_buffer;
+  // Pooled buffer of the current partition, if staged is set.
+  std::vector<hazelcast::byte> staging;
+  bool staged = false;
+
+  // Bytes of the memory budget held, see HazelcastMemoryBudget.
+  uint64_t reserved_bytes = 0;
+
+  // Keys of the partitions written, removed if the insert is aborted
+  // for its size or memory.
+  std::vector<std::string> written_keys;
+
+  // Entries of the response in write-behind mode, pushed to the queue
+  // once the response completes.
+  HazelcastPendingInsertPtr pending;
+
+  // Kept to compute the variant key from the response headers.
+  const LookupContextPtr lookup;
 
 };
+
 }
 
 HazelcastHttpCache::HazelcastHttpCache(HazelcastConfig config)
   : hz_config_(config),
-  BODY_PARTITION_SIZE(config.body_partition_size() == 0 ?
-                      DEFAULT_PARTITION_SIZE :
-                      config.body_partition_size()) {};
+  partition_schedule_(partitionScheduleOf(config)),
+  tracer_(config),
+  codecs_(config.body_compression()),
+  buffer_pool_(config.buffer_pool()),
+  admission_filter_(config.admission()),
+  memory_budget_(config.max_insert_memory()),
+  rate_limiter_(config.insert_rate_limit()) {
+  for (const std::string& name : config.allowed_vary_headers()) {
+    allowed_vary_headers_.emplace_back(absl::AsciiStrToLower(name));
+  }
+  if (allowed_vary_headers_.empty()) {
+    allowed_vary_headers_.push_back(Http::Headers::get().AcceptEncoding);
+    allowed_vary_headers_.emplace_back("accept-language");
+  }
+  validateLegacyFormat(config);
+};
+
+HazelcastHttpCache::HazelcastHttpCache(HazelcastConfig config,
+    StorageBackendPtr&& backend) : HazelcastHttpCache(config) {
+  backend_ = std::move(backend);
+  startBackgroundThreads();
+}
+
+void HazelcastHttpCache::startBackgroundThreads() {
+  if (!backend_) return;
+  if (HazelcastWriteBehindQueue::enabled(hz_config_.write_behind())) {
+    write_behind_ = std::make_unique<HazelcastWriteBehindQueue>(
+        hz_config_.write_behind(), *backend_, memory_budget_, rate_limiter_,
+        operation_stats_);
+  }
+  if (admission_filter_.enabled() && admission_filter_.shared()) {
+    shared_admission_ = std::make_unique<HazelcastSharedAdmission>(
+        admission_filter_, *backend_);
+  }
+}
 
 LookupContextPtr HazelcastHttpCache::
   makeLookupContext(LookupRequest&& request) {
-  return std::make_unique<HazelcastLookupContext>(*this, std::move(request));
+  return makeLookupContext(std::move(request), Tracing::NullSpan::instance());
+}
+
+LookupContextPtr HazelcastHttpCache::
+  makeLookupContext(LookupRequest&& request, Tracing::Span& parent_span) {
+  // LookupRequest does not keep the request headers.
+  return std::make_unique<HazelcastLookupContext>(*this, std::move(request),
+      nullptr, std::chrono::system_clock::now(), parent_span);
+}
+
+LookupContextPtr HazelcastHttpCache::
+  makeLookupContext(LookupRequest&& request,
+      const Http::HeaderMap& request_headers, SystemTime request_time,
+      Tracing::Span& parent_span) {
+  return std::make_unique<HazelcastLookupContext>(*this, std::move(request),
+      &request_headers, request_time, parent_span);
 }
 
 InsertContextPtr HazelcastHttpCache::
   makeInsertContext(LookupContextPtr&& lookup_context) {
   ASSERT(lookup_context != nullptr);
-  return std::make_unique<HazelcastInsertContext>(*lookup_context, *this);
+  return std::make_unique<HazelcastInsertContext>(std::move(lookup_context),
+      *this);
+}
+
+void HazelcastHttpCache::lookupBody(absl::string_view key,
+    BodyLookupCallback&& cb) {
+  HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+  backend_->getBody(key, [this, start, cb = std::move(cb)]
+      (HazelcastBodyPtr&& entry) {
+    operation_stats_.end(HazelcastOperation::LookupBody, start);
+    if (entry && !entry->supported()) {
+      // Written by a newer version, treated as a miss.
+      entry.reset();
+    }
+    cb(std::move(entry));
+  });
+}
+
+void HazelcastHttpCache::admitInsert(const uint64_t& hash_key,
+    std::function<void(bool admitted)>&& cb) {
+  if (!admission_filter_.enabled()) {
+    cb(true);
+    return;
+  }
+  const uint32_t count = admission_filter_.increment(hash_key);
+  if (admission_filter_.shared()) {
+    // Added to the shared count in the background, see
+    // HazelcastSharedAdmission.
+    admission_filter_.recordShared(hash_key);
+  }
+  cb(admission_filter_.admit(count));
 }
 
-HazelcastBodyPtr HazelcastHttpCache::
-  lookupBody(const std::string& key) {
-  return hz->getMap<std::string, HazelcastBodyEntry>
-      (hz_config_.body_map_name()).get(key);
+void HazelcastHttpCache::limitInsert(uint64_t bytes,
+    std::function<void(bool allowed)>&& cb) {
+  cb(rate_limiter_.allow(bytes, *backend_));
 }
 
-HazelcastHeaderPtr HazelcastHttpCache::
-  lookupHeader(const uint64_t& hash_key) {
-  return hz->getMap<int64_t, HazelcastHeaderEntry>
-      (hz_config_.header_map_name()).get(static_cast<int64_t>(hash_key));
+void HazelcastHttpCache::lookupHeader(const uint64_t& hash_key,
+    HeaderLookupCallback&& cb) {
+  HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+  backend_->getHeader(hash_key, [this, start, cb = std::move(cb)]
+      (HazelcastHeaderPtr&& entry) {
+    operation_stats_.end(HazelcastOperation::LookupHeader, start);
+    if (entry && !entry->supported()) {
+      // Written by a newer version, treated as a miss.
+      entry.reset();
+    }
+    cb(std::move(entry));
+  });
 }
 
-void HazelcastHttpCache::insertBody(
-    std::string&& hash_key, const HazelcastBodyEntry& entry) {
-  hz->getMap<std::string, HazelcastBodyEntry>
-      (hz_config_.body_map_name()).put(std::move(hash_key),entry);
+void HazelcastHttpCache::insertBody(const std::string& key,
+    const HazelcastBodyEntry& entry, StorageCallback&& cb) {
+  HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+  backend_->putBody(key, entry, [this, start, cb = std::move(cb)]
+      (bool success) {
+    operation_stats_.end(HazelcastOperation::InsertBody, start);
+    cb(success);
+  });
 }
 
-void HazelcastHttpCache::insertHeader(
-     const uint64_t& hash_key, const HazelcastHeaderEntry& entry) {
-    hz->getMap<int64_t, HazelcastHeaderEntry>
-      (hz_config_.header_map_name()).put(static_cast<int64_t>(hash_key),entry);
+void HazelcastHttpCache::insertHeader(const uint64_t& hash_key,
+    const HazelcastHeaderEntry& entry, StorageCallback&& cb) {
+  HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+  backend_->putHeader(hash_key, entry, [this, start, cb = std::move(cb)]
+      (bool success) {
+    operation_stats_.end(HazelcastOperation::InsertHeader, start);
+    cb(success);
+  });
 }
 
 void HazelcastHttpCache::updateHeaders(LookupContextPtr&& lookup_context,
@@ -238,6 +1232,20 @@ void HazelcastHttpCache::updateHeaders(LookupContextPtr&& lookup_context,
   ASSERT(false);
 }
 
+bool HazelcastHttpCache::varyAllowed(
+    const std::vector<std::string>& vary) const {
+  for (const std::string& name : vary) {
+    if (std::find_if(allowed_vary_headers_.begin(),
+        allowed_vary_headers_.end(),
+        [&name](const Http::LowerCaseString& allowed) {
+      return allowed.get() == name;
+    }) == allowed_vary_headers_.end()) {
+      return false; // also for "*"
+    }
+  }
+  return true;
+}
+
 CacheInfo HazelcastHttpCache::cacheInfo() const {
   CacheInfo cache_info;
   cache_info.name_ = "envoy.extensions.http.cache.hazelcast";
@@ -245,37 +1253,30 @@ CacheInfo HazelcastHttpCache::cacheInfo() const {
   return cache_info;
 }
 
-inline const uint64_t& HazelcastHttpCache::bodySizePerEntry(){
-  return BODY_PARTITION_SIZE;
-}
 void HazelcastHttpCache::clearMaps() {
-  hz->getMap<std::string, HazelcastBodyEntry>
-      (hz_config_.body_map_name()).clear();
-  hz->getMap<std::string, HazelcastHeaderEntry>
-      (hz_config_.header_map_name()).clear();
+  backend_->clear();
 }
-void HazelcastHttpCache::connect() {
-  if (hz) return;
-  ClientConfig config;
-  config.getGroupConfig().setName(hz_config_.group_name());
-
-  config.getNetworkConfig().addAddress(
-      hazelcast::client::Address(hz_config_.ip(),hz_config_.port()));
-
-  config.getSerializationConfig().addDataSerializableFactory(
-      HazelcastCacheEntrySerializableFactory::FACTORY_ID,
-      boost::shared_ptr<serialization::DataSerializableFactory>
-          (new HazelcastCacheEntrySerializableFactory()));
-
-  hz = std::make_unique<HazelcastClient>(config);
 
+void HazelcastHttpCache::connect() {
+  if (backend_) return;
+  if (hz_config_.has_local_backend()) {
+    // Request counts expire as they do on the cluster.
+    const uint32_t window_s = hz_config_.admission().shared_window_s();
+    backend_ = std::make_unique<LocalStorageBackend>(window_s > 0 ?
+        std::chrono::seconds(window_s) :
+        LocalStorageBackend::DEFAULT_REQUEST_COUNT_TTL);
+  } else {
+    backend_ = std::make_unique<RemoteStorageBackend>(hz_config_);
+  }
+  startBackgroundThreads();
 }
 
 void HazelcastHttpCache::disconnect() {
-  if (hz) {
-    hz->shutdown();
-    hz.release();
-  }
+  // Writes the queued responses and misses before the backend goes
+  // away.
+  write_behind_.reset();
+  shared_admission_.reset();
+  backend_.reset();
 }
 
 HazelcastHttpCache::~HazelcastHttpCache() {
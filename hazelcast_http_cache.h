@@ -4,9 +4,16 @@
 #pragma once
 
 #include "extensions/filters/http/cache/http_cache.h"
-#include "hazelcast/client/HazelcastClient.h"
-#include "hazelcast/client/IMap.h"
+#include "hazelcast_admission_filter.h"
+#include "hazelcast_body_codec.h"
+#include "hazelcast_buffer_pool.h"
 #include "hazelcast_cache_entry.h"
+#include "hazelcast_cache_stats.h"
+#include "hazelcast_cache_tracer.h"
+#include "hazelcast_memory_budget.h"
+#include "hazelcast_rate_limiter.h"
+#include "hazelcast_storage_backend.h"
+#include "hazelcast_write_behind.h"
 #include "hazelcast.pb.h"
 
 namespace Envoy {
@@ -14,13 +21,15 @@ namespace Extensions {
 namespace HttpFilters {
 namespace Cache {
 
-using hazelcast::client::IMap;
-
 class HazelcastHttpCache : public HttpCache {
 
 public:
+  // Throws EnvoyException if the configuration is invalid.
   HazelcastHttpCache(HazelcastConfig config);
 
+  // Uses the given storage instead of the one created on connect().
+  HazelcastHttpCache(HazelcastConfig config, StorageBackendPtr&& backend);
+
   // Cache::HttpCache
   LookupContextPtr makeLookupContext(LookupRequest&& request) override;
   InsertContextPtr makeInsertContext
@@ -29,24 +38,111 @@ public:
       Http::HeaderMapPtr&& response_headers) override;
   CacheInfo cacheInfo() const override;
 
-  void insertHeader(const uint64_t& hash_key, const HazelcastHeaderEntry& entry);
-  void insertBody(std::string&& hash_key, const HazelcastBodyEntry& entry);
-  HazelcastHeaderPtr lookupHeader(const uint64_t& hash_key);
-  HazelcastBodyPtr lookupBody(const std::string& key);
-  const uint64_t& bodySizePerEntry();
+  // Creates a lookup context whose Hazelcast round trips are reported
+  // as child spans of the given span.
+  // TODO: The filter does not pass the active span to the cache yet,
+  //  hence makeLookupContext(LookupRequest&&) uses a null span.
+  LookupContextPtr makeLookupContext(LookupRequest&& request,
+      Tracing::Span& parent_span);
+
+  // Same as above, with the request headers and time not kept by
+  // LookupRequest. Without the headers, compressed entries are always
+  // decompressed on lookup, and responses with Vary are neither found
+  // nor inserted since the variant of the request is unknown. The time
+  // has to be the one the request is created with, to decide freshness
+  // the same way.
+  LookupContextPtr makeLookupContext(LookupRequest&& request,
+      const Http::HeaderMap& request_headers, SystemTime request_time,
+      Tracing::Span& parent_span);
+
+  // Storage operations of the contexts. Callbacks are invoked before
+  // these calls return (see hazelcast_storage_backend.h).
+  void insertHeader(const uint64_t& hash_key,
+      const HazelcastHeaderEntry& entry, StorageCallback&& cb);
+  void insertBody(const std::string& key, const HazelcastBodyEntry& entry,
+      StorageCallback&& cb);
+  void lookupHeader(const uint64_t& hash_key, HeaderLookupCallback&& cb);
+  void lookupBody(absl::string_view key, BodyLookupCallback&& cb);
+
+  // Counts a cacheable miss of the key and passes whether its response
+  // is inserted (see hazelcast_admission_filter.h).
+  void admitInsert(const uint64_t& hash_key,
+      std::function<void(bool admitted)>&& cb);
+
+  // Passes whether a partition of the given stored size is written
+  // now, within the insert rate limit (see hazelcast_rate_limiter.h).
+  void limitInsert(uint64_t bytes, std::function<void(bool allowed)>&& cb);
+
+  // Partition sizes of the bodies inserted. Lookups use the schedule
+  // recorded in the header entry, see entrySchedule.
+  const HazelcastPartitionSchedule& partitionSchedule() const {
+    return partition_schedule_;
+  }
+  // Partition sizes of the body of a read entry. Legacy entries do not
+  // record the schedule they were written with, hence the configured
+  // one is theirs.
+  const HazelcastPartitionSchedule& entrySchedule(
+      const HazelcastHeaderEntry& header_entry) const {
+    return header_entry.legacyFormat() ? partition_schedule_ :
+        header_entry.partition_schedule;
+  }
+  bool deduplicateBodies() const { return hz_config_.deduplicate_bodies(); }
+  // Entries are written in the format before versioning, see
+  // hazelcast_cache_entry.h.
+  bool legacyEntryFormat() const { return hz_config_.legacy_entry_format(); }
+  // Responses with larger bodies are not stored. Zero if unlimited.
+  uint64_t maxObjectSize() const { return hz_config_.max_object_size(); }
+
+  // Request headers a cached response may vary on, and whether a
+  // response varying on the given (lower case) headers is cached.
+  const std::vector<Http::LowerCaseString>& allowedVaryHeaders() const {
+    return allowed_vary_headers_;
+  }
+  bool varyAllowed(const std::vector<std::string>& vary) const;
+  const HazelcastCacheTracer& tracer() const { return tracer_; }
+  const HazelcastBodyCodecs& codecs() const { return codecs_; }
+  HazelcastBufferPool& bufferPool() { return buffer_pool_; }
+  HazelcastAdmissionFilter& admissionFilter() { return admission_filter_; }
+  // Shared by the inserts of all workers.
+  HazelcastMemoryBudget& memoryBudget() { return memory_budget_; }
+  HazelcastRateLimiter& rateLimiter() { return rate_limiter_; }
+  // Queue of the complete responses if write-behind is configured,
+  // nullptr if inserts are written inline.
+  HazelcastWriteBehindQueue* writeBehind() { return write_behind_.get(); }
+
+  // Introspection helpers. See hazelcast_cache_admin.h
+  HazelcastOperationStats& operationStats() { return operation_stats_; }
+  HazelcastInsertStats& insertStats() { return insert_stats_; }
+  StorageBackend& backend() { return *backend_; }
+  bool isConnected() { return backend_ && backend_->isConnected(); }
   void clearMaps(); // For testing only
 
+  // Creates the storage backend configured unless one is given
+  // on construction. The Hazelcast client connects to the cluster
+  // here. Queued responses are written on disconnect.
   void connect();
   void disconnect();
 
   ~HazelcastHttpCache();
 private:
-  HazelcastConfig hz_config_;
-  std::unique_ptr<HazelcastClient> hz;
-  const uint64_t BODY_PARTITION_SIZE;
-  static const uint64_t DEFAULT_PARTITION_SIZE = 1024;
+  // Starts the write-behind queue and the shared admission syncs on
+  // the backend, if configured.
+  void startBackgroundThreads();
 
-  // TODO: Inject IMaps via local fields.
+  HazelcastConfig hz_config_;
+  StorageBackendPtr backend_;
+  const HazelcastPartitionSchedule partition_schedule_;
+  const HazelcastCacheTracer tracer_;
+  const HazelcastBodyCodecs codecs_;
+  HazelcastBufferPool buffer_pool_;
+  HazelcastAdmissionFilter admission_filter_;
+  HazelcastMemoryBudget memory_budget_;
+  HazelcastRateLimiter rate_limiter_;
+  std::vector<Http::LowerCaseString> allowed_vary_headers_;
+  HazelcastOperationStats operation_stats_;
+  HazelcastInsertStats insert_stats_;
+  HazelcastWriteBehindQueuePtr write_behind_;
+  HazelcastSharedAdmissionPtr shared_admission_;
 };
 
 } // namespace Cache
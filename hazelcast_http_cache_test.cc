@@ -6,10 +6,9 @@
  *
  */
 #include "envoy/registry/registry.h"
-#include "test/test_common/simulated_time_system.h"
-#include "test/test_common/utility.h"
-#include "gtest/gtest.h"
-#include "hazelcast_http_cache.h"
+#include "test/mocks/server/mocks.h"
+#include "hazelcast_http_cache_test_base.h"
+#include "hazelcast_cache_admin.h"
 #include "hazelcast.pb.h"
 
 namespace Envoy {
@@ -30,7 +29,7 @@ static HazelcastConfig getTestConfig(){
   return hc;
 }
 
-class HazelcastHttpCacheTest : public testing::Test {
+class HazelcastHttpCacheTest : public HazelcastHttpCacheTestBase {
 protected:
 
   HazelcastHttpCacheTest() {
@@ -38,93 +37,7 @@ protected:
     hz_cache_ptr = std::make_unique<HazelcastHttpCache>(cfg);
     hz_cache_ptr->connect();
     hz_cache_ptr->clearMaps();
-    request_headers_.setMethod("GET");
-    request_headers_.setHost("example.com");
-    request_headers_.setForwardedProto("https");
-    request_headers_.setCacheControl("max-age=3600");
   }
-
-  static void SetUpTestSuite() {}
-
-  static void TearDownTestSuite() {}
-
-  // Performs a cache lookup.
-  LookupContextPtr lookup(absl::string_view request_path) {
-    LookupRequest request = makeLookupRequest(request_path);
-    LookupContextPtr context = hz_cache_ptr->makeLookupContext
-        (std::move(request));
-    context->getHeaders([this](LookupResult&& result) {
-      lookup_result_ = std::move(result); });
-    return context;
-  }
-
-  // Inserts a value into the cache.
-  void insert(LookupContextPtr lookup,
-      const Http::TestHeaderMapImpl& response_headers,
-      const absl::string_view response_body) {
-    InsertContextPtr inserter = hz_cache_ptr->makeInsertContext(move(lookup));
-    inserter->insertHeaders(response_headers, false);
-    inserter->insertBody(Buffer::OwnedImpl(response_body), nullptr, true);
-  }
-
-  void insert(absl::string_view request_path,
-      const Http::TestHeaderMapImpl& response_headers,
-      const absl::string_view response_body) {
-    insert(lookup(request_path), response_headers, response_body);
-  }
-
-  std::string getBody(LookupContext& context, uint64_t start, uint64_t end) {
-    std::string full_body;
-    std::string body_chunk;
-    uint64_t start_ = start;
-
-    while (full_body.length() != end - start) {
-      AdjustedByteRange range(start_, end);
-      context.getBody(range, [&body_chunk, &start_,
-                              &full_body](Buffer::InstancePtr&& data) {
-        EXPECT_NE(data, nullptr);
-        if (data) {
-          body_chunk = data->toString();
-          full_body.append(body_chunk);
-          start_ += body_chunk.length();
-        }
-      });
-    }
-    return full_body;
-  }
-
-  LookupRequest makeLookupRequest(absl::string_view request_path) {
-    request_headers_.setPath(request_path);
-    return LookupRequest(request_headers_, current_time_);
-  }
-
-  AssertionResult expectLookupSuccessWithBody(LookupContext* lookup_context,
-                                              absl::string_view body) {
-    if (lookup_result_.cache_entry_status_ != CacheEntryStatus::Ok) {
-      return AssertionFailure() << "Expected: lookup_result_.cache_entry_status"
-                                   " == CacheEntryStatus::Ok\n  Actual: "
-                                << lookup_result_.cache_entry_status_;
-    }
-    if (!lookup_result_.headers_) {
-      return AssertionFailure() << "Expected nonnull lookup_result_.headers";
-    }
-    if (!lookup_context) {
-      return AssertionFailure() << "Expected nonnull lookup_context";
-    }
-    const std::string actual_body = getBody(*lookup_context, 0, body.size());
-    if (body != actual_body) {
-      return AssertionFailure() << "Expected body == " << body <<
-      "\n  Actual:  " << actual_body;
-    }
-    return AssertionSuccess();
-  }
-
-  std::unique_ptr<HazelcastHttpCache> hz_cache_ptr;
-  LookupResult lookup_result_;
-  Http::TestHeaderMapImpl request_headers_;
-  Event::SimulatedTimeSystem time_source_;
-  SystemTime current_time_ = time_source_.systemTime();
-  DateFormatter formatter_{"%a, %d %b %Y %H:%M:%S GMT"};
 };
 
 // Simple flow of putting in an item, getting it, deleting it.
@@ -255,6 +168,45 @@ TEST_F(HazelcastHttpCacheTest, StreamingPut) {
   hz_cache_ptr->clearMaps();
 }
 
+TEST_F(HazelcastHttpCacheTest, AdminInspect) {
+  Http::TestHeaderMapImpl response_headers{
+    {"date", formatter_.fromTime(current_time_)},
+    {"cache-control", "public, max-age=3600"}};
+  const std::string body(2500, 'h');
+  insert("/admin", response_headers, body);
+
+  HazelcastCacheAdmin admin(*hz_cache_ptr);
+  Http::TestHeaderMapImpl admin_response_headers;
+  Server::MockAdminStream admin_stream;
+
+  Buffer::OwnedImpl status;
+  EXPECT_EQ(Http::Code::OK, admin.handlerStatus(
+      HazelcastCacheAdmin::STATUS_PREFIX, admin_response_headers, status,
+      admin_stream));
+  EXPECT_NE(std::string::npos, status.toString().find("connected: true"));
+  EXPECT_NE(std::string::npos, status.toString().find("insert_body: completed=3"));
+
+  Buffer::OwnedImpl inspect;
+  EXPECT_EQ(Http::Code::OK, admin.handlerInspect(
+      HazelcastCacheAdmin::INSPECT_PREFIX + "?host=example.com&path=/admin",
+      admin_response_headers, inspect, admin_stream));
+  const std::string inspected = inspect.toString();
+  EXPECT_NE(std::string::npos, inspected.find("total_body_size: 2500"));
+  EXPECT_NE(std::string::npos, inspected.find("partition_count: 3"));
+  EXPECT_NE(std::string::npos, inspected.find("cache-control: public, max-age=3600"));
+
+  Buffer::OwnedImpl missing;
+  EXPECT_EQ(Http::Code::NotFound, admin.handlerInspect(
+      HazelcastCacheAdmin::INSPECT_PREFIX + "?host=example.com&path=/missing",
+      admin_response_headers, missing, admin_stream));
+
+  Buffer::OwnedImpl bad_key;
+  EXPECT_EQ(Http::Code::BadRequest, admin.handlerInspect(
+      HazelcastCacheAdmin::INSPECT_PREFIX + "?key=abc",
+      admin_response_headers, bad_key, admin_stream));
+  hz_cache_ptr->clearMaps();
+}
+
 TEST(Registration, GetFactory) {
   envoy::config::filter::http::cache::v2::CacheConfig config;
   HazelcastConfig hz_cfg = getTestConfig();
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "common/tracing/http_tracer_impl.h"
+#include "test/test_common/simulated_time_system.h"
+#include "test/test_common/utility.h"
+#include "gtest/gtest.h"
+#include "hazelcast_http_cache.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Common fixture of the cache tests. Provides lookup and insert
+ * helpers in the way the cache filter uses the cache.
+ */
+class HazelcastHttpCacheTestBase : public testing::Test {
+protected:
+
+  // Derived fixtures create the cache under test.
+  HazelcastHttpCacheTestBase() {
+    request_headers_.setMethod("GET");
+    request_headers_.setHost("example.com");
+    request_headers_.setForwardedProto("https");
+    request_headers_.setCacheControl("max-age=3600");
+  }
+
+  static void SetUpTestSuite() {}
+
+  static void TearDownTestSuite() {}
+
+  // Performs a cache lookup with request_headers_.
+  LookupContextPtr lookup(absl::string_view request_path) {
+    LookupRequest request = makeLookupRequest(request_path);
+    LookupContextPtr context = hz_cache_ptr->makeLookupContext
+        (std::move(request), request_headers_, current_time_,
+        Tracing::NullSpan::instance());
+    context->getHeaders([this](LookupResult&& result) {
+      lookup_result_ = std::move(result); });
+    return context;
+  }
+
+  // Inserts a value into the cache.
+  void insert(LookupContextPtr lookup,
+      const Http::TestHeaderMapImpl& response_headers,
+      const absl::string_view response_body) {
+    InsertContextPtr inserter = hz_cache_ptr->makeInsertContext(move(lookup));
+    inserter->insertHeaders(response_headers, false);
+    inserter->insertBody(Buffer::OwnedImpl(response_body), nullptr, true);
+  }
+
+  void insert(absl::string_view request_path,
+      const Http::TestHeaderMapImpl& response_headers,
+      const absl::string_view response_body) {
+    insert(lookup(request_path), response_headers, response_body);
+  }
+
+  std::string getBody(LookupContext& context, uint64_t start, uint64_t end) {
+    std::string full_body;
+    std::string body_chunk;
+    uint64_t start_ = start;
+
+    while (full_body.length() != end - start) {
+      AdjustedByteRange range(start_, end);
+      context.getBody(range, [&body_chunk, &start_,
+                              &full_body](Buffer::InstancePtr&& data) {
+        EXPECT_NE(data, nullptr);
+        if (data) {
+          body_chunk = data->toString();
+          full_body.append(body_chunk);
+          start_ += body_chunk.length();
+        }
+      });
+    }
+    return full_body;
+  }
+
+  LookupRequest makeLookupRequest(absl::string_view request_path) {
+    request_headers_.setPath(request_path);
+    return LookupRequest(request_headers_, current_time_);
+  }
+
+  AssertionResult expectLookupSuccessWithBody(LookupContext* lookup_context,
+                                              absl::string_view body) {
+    if (lookup_result_.cache_entry_status_ != CacheEntryStatus::Ok) {
+      return AssertionFailure() << "Expected: lookup_result_.cache_entry_status"
+                                   " == CacheEntryStatus::Ok\n  Actual: "
+                                << lookup_result_.cache_entry_status_;
+    }
+    if (!lookup_result_.headers_) {
+      return AssertionFailure() << "Expected nonnull lookup_result_.headers";
+    }
+    if (!lookup_context) {
+      return AssertionFailure() << "Expected nonnull lookup_context";
+    }
+    const std::string actual_body = getBody(*lookup_context, 0, body.size());
+    if (body != actual_body) {
+      return AssertionFailure() << "Expected body == " << body <<
+      "\n  Actual:  " << actual_body;
+    }
+    return AssertionSuccess();
+  }
+
+  std::unique_ptr<HazelcastHttpCache> hz_cache_ptr;
+  LookupResult lookup_result_;
+  Http::TestHeaderMapImpl request_headers_;
+  Event::SimulatedTimeSystem time_source_;
+  SystemTime current_time_ = time_source_.systemTime();
+  DateFormatter formatter_{"%a, %d %b %Y %H:%M:%S GMT"};
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,225 @@
+#include "hazelcast_local_backend.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+// Additions of request counts between two removals of expired ones.
+const uint64_t REQUEST_COUNT_EXPIRY_INTERVAL = 1024;
+
+}
+
+const std::string LocalStorageBackend::LOCAL_ADDRESS = "local";
+constexpr std::chrono::milliseconds
+    LocalStorageBackend::DEFAULT_REQUEST_COUNT_TTL;
+
+LocalStorageBackend::LocalStorageBackend(
+    std::chrono::milliseconds request_count_ttl)
+  : request_count_ttl_(request_count_ttl) {
+  serialization_config_.addDataSerializableFactory(
+      HazelcastCacheEntrySerializableFactory::FACTORY_ID,
+      boost::shared_ptr<hazelcast::client::serialization::DataSerializableFactory>
+          (new HazelcastCacheEntrySerializableFactory()));
+  serializer_ = std::make_unique<SerializationService>(serialization_config_);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// SerializationService::toObject returns std::auto_ptr.
+// Hence the warnings are suppressed here.
+
+void LocalStorageBackend::getHeader(const uint64_t& hash_key,
+    HeaderLookupCallback&& cb) {
+  Data data;
+  bool found = false;
+  {
+    absl::MutexLock lock(&map_mutex_);
+    auto it = header_map_.find(hash_key);
+    if (it != header_map_.end()) {
+      data = it->second;
+      found = true;
+    }
+  }
+  cb(found ? HazelcastHeaderPtr(serializer_->toObject<HazelcastHeaderEntry>(data)) :
+      nullptr);
+}
+
+void LocalStorageBackend::getBody(absl::string_view key,
+    BodyLookupCallback&& cb) {
+  Data data;
+  bool found = false;
+  {
+    absl::MutexLock lock(&map_mutex_);
+    auto it = body_map_.find(key);
+    if (it != body_map_.end()) {
+      data = it->second;
+      found = true;
+    }
+  }
+  cb(found ? HazelcastBodyPtr(serializer_->toObject<HazelcastBodyEntry>(data)) :
+      nullptr);
+}
+
+#pragma GCC diagnostic pop
+
+void LocalStorageBackend::putHeader(const uint64_t& hash_key,
+    const HazelcastHeaderEntry& entry, StorageCallback&& cb) {
+  Data data = serializer_->toData<HazelcastHeaderEntry>(&entry);
+  {
+    absl::MutexLock lock(&map_mutex_);
+    header_map_[hash_key] = std::move(data);
+  }
+  cb(true);
+}
+
+void LocalStorageBackend::putBody(const std::string& key,
+    const HazelcastBodyEntry& entry, StorageCallback&& cb) {
+  Data data = serializer_->toData<HazelcastBodyEntry>(&entry);
+  {
+    absl::MutexLock lock(&map_mutex_);
+    body_map_[key] = std::move(data);
+  }
+  cb(true);
+}
+
+void LocalStorageBackend::removeBody(const std::string& key,
+    StorageCallback&& cb) {
+  {
+    absl::MutexLock lock(&map_mutex_);
+    body_map_.erase(key);
+  }
+  cb(true);
+}
+
+void LocalStorageBackend::putHeaders(
+    const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+    StorageCallback&& cb) {
+  std::vector<std::pair<uint64_t, Data>> serialized;
+  serialized.reserve(entries.size());
+  for (const auto& entry : entries) {
+    serialized.emplace_back(entry.first,
+        serializer_->toData<HazelcastHeaderEntry>(&entry.second));
+  }
+  {
+    absl::MutexLock lock(&map_mutex_);
+    for (auto& entry : serialized) {
+      header_map_[entry.first] = std::move(entry.second);
+    }
+  }
+  cb(true);
+}
+
+void LocalStorageBackend::putBodies(
+    const std::map<std::string, HazelcastBodyEntry>& entries,
+    StorageCallback&& cb) {
+  std::vector<std::pair<std::string, Data>> serialized;
+  serialized.reserve(entries.size());
+  for (const auto& entry : entries) {
+    serialized.emplace_back(entry.first,
+        serializer_->toData<HazelcastBodyEntry>(&entry.second));
+  }
+  {
+    absl::MutexLock lock(&map_mutex_);
+    for (auto& entry : serialized) {
+      body_map_[entry.first] = std::move(entry.second);
+    }
+  }
+  cb(true);
+}
+
+void LocalStorageBackend::addRequestCount(const uint64_t& hash_key,
+    uint64_t misses, CountCallback&& cb) {
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  uint64_t count;
+  {
+    absl::MutexLock lock(&map_mutex_);
+    if (++request_count_additions_ % REQUEST_COUNT_EXPIRY_INTERVAL == 0) {
+      expireRequestCounts(now);
+    }
+    auto it = request_counts_.find(hash_key);
+    if (it == request_counts_.end() || it->second.expiry <= now) {
+      // Lives for the window from its first miss, as on the cluster.
+      request_counts_[hash_key] = {misses, now + request_count_ttl_};
+      count = misses;
+    } else {
+      count = it->second.count += misses;
+    }
+  }
+  cb(count);
+}
+
+void LocalStorageBackend::expireRequestCounts(
+    std::chrono::steady_clock::time_point now) {
+  for (auto it = request_counts_.begin(); it != request_counts_.end();) {
+    if (it->second.expiry <= now) {
+      request_counts_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void LocalStorageBackend::addInsertedBytes(int64_t window, uint64_t bytes,
+    CountCallback&& cb) {
+  uint64_t total;
+  {
+    absl::MutexLock lock(&map_mutex_);
+    // Past windows are not needed anymore, as on the cluster they expire.
+    for (auto it = inserted_bytes_.begin(); it != inserted_bytes_.end();) {
+      if (it->first < window) {
+        inserted_bytes_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    total = inserted_bytes_[window] += bytes;
+  }
+  cb(total);
+}
+
+void LocalStorageBackend::clear() {
+  absl::MutexLock lock(&map_mutex_);
+  header_map_.clear();
+  body_map_.clear();
+  request_counts_.clear();
+  inserted_bytes_.clear();
+}
+
+std::vector<std::string> LocalStorageBackend::memberAddresses() {
+  return {LOCAL_ADDRESS};
+}
+
+std::string LocalStorageBackend::headerOwnerAddress(const uint64_t&) {
+  return LOCAL_ADDRESS;
+}
+
+std::string LocalStorageBackend::bodyOwnerAddress(const std::string&) {
+  return LOCAL_ADDRESS;
+}
+
+int64_t LocalStorageBackend::headerExpirationTime(const uint64_t& hash_key) {
+  // Entries never expire on the local backend.
+  absl::MutexLock lock(&map_mutex_);
+  return header_map_.contains(hash_key) ?
+      std::numeric_limits<int64_t>::max() : -1;
+}
+
+size_t LocalStorageBackend::headerCount() {
+  absl::MutexLock lock(&map_mutex_);
+  return header_map_.size();
+}
+
+size_t LocalStorageBackend::bodyCount() {
+  absl::MutexLock lock(&map_mutex_);
+  return body_map_.size();
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "hazelcast/client/SerializationConfig.h"
+#include "hazelcast/client/serialization/pimpl/SerializationService.h"
+#include "hazelcast_storage_backend.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+using hazelcast::client::serialization::pimpl::Data;
+using hazelcast::client::serialization::pimpl::SerializationService;
+
+/**
+ * In-process storage backend.
+ *
+ * Intended for tests and benchmarks of the cache logic without a
+ * Hazelcast cluster. Entries are serialized with the client's
+ * SerializationService on insert and deserialized on lookup, so the
+ * entry formats and the copy costs are the same as on a cluster,
+ * except for networking.
+ */
+class LocalStorageBackend : public StorageBackend {
+public:
+  // Request counts expire after request_count_ttl, as the admission
+  // window does on the cluster.
+  explicit LocalStorageBackend(std::chrono::milliseconds request_count_ttl =
+      DEFAULT_REQUEST_COUNT_TTL);
+
+  // StorageBackend
+  void getHeader(const uint64_t& hash_key, HeaderLookupCallback&& cb) override;
+  void getBody(absl::string_view key, BodyLookupCallback&& cb) override;
+  void putHeader(const uint64_t& hash_key, const HazelcastHeaderEntry& entry,
+      StorageCallback&& cb) override;
+  void putBody(const std::string& key, const HazelcastBodyEntry& entry,
+      StorageCallback&& cb) override;
+  void removeBody(const std::string& key, StorageCallback&& cb) override;
+  void putHeaders(const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+      StorageCallback&& cb) override;
+  void putBodies(const std::map<std::string, HazelcastBodyEntry>& entries,
+      StorageCallback&& cb) override;
+  void addRequestCount(const uint64_t& hash_key, uint64_t misses,
+      CountCallback&& cb) override;
+  void addInsertedBytes(int64_t window, uint64_t bytes,
+      CountCallback&& cb) override;
+  void clear() override;
+  bool isConnected() override { return true; }
+  std::vector<std::string> memberAddresses() override;
+  std::string headerOwnerAddress(const uint64_t&) override;
+  std::string bodyOwnerAddress(const std::string&) override;
+  int64_t headerExpirationTime(const uint64_t& hash_key) override;
+
+  // Number of stored entries. Intended for tests.
+  size_t headerCount();
+  size_t bodyCount();
+
+  static const std::string LOCAL_ADDRESS;
+  static constexpr std::chrono::milliseconds DEFAULT_REQUEST_COUNT_TTL =
+      std::chrono::hours(1);
+
+private:
+  struct RequestCount {
+    uint64_t count;
+    std::chrono::steady_clock::time_point expiry;
+  };
+
+  // Removes the expired request counts.
+  void expireRequestCounts(std::chrono::steady_clock::time_point now)
+      EXCLUSIVE_LOCKS_REQUIRED(map_mutex_);
+
+  hazelcast::client::SerializationConfig serialization_config_;
+  std::unique_ptr<SerializationService> serializer_;
+
+  absl::Mutex map_mutex_;
+  absl::flat_hash_map<uint64_t, Data> header_map_ GUARDED_BY(map_mutex_);
+  absl::flat_hash_map<std::string, Data> body_map_ GUARDED_BY(map_mutex_);
+  const std::chrono::milliseconds request_count_ttl_;
+  absl::flat_hash_map<uint64_t, RequestCount> request_counts_
+      GUARDED_BY(map_mutex_);
+  // Additions since expired counts were last removed.
+  uint64_t request_count_additions_ GUARDED_BY(map_mutex_) = 0;
+  absl::flat_hash_map<int64_t, uint64_t> inserted_bytes_
+      GUARDED_BY(map_mutex_);
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,956 @@
+/**
+ * Tests of the cache logic on the in-process storage backend. Unlike
+ * hazelcast_http_cache_test.cc, no Hazelcast cluster is needed.
+ */
+#include <functional>
+#include <thread>
+
+#include "envoy/common/exception.h"
+#include "hazelcast_admission_filter.h"
+#include "hazelcast_body_codec.h"
+#include "hazelcast_http_cache_test_base.h"
+#include "hazelcast_fault_injecting_backend.h"
+#include "hazelcast_write_behind.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+class HazelcastLocalCacheTest : public HazelcastHttpCacheTestBase {
+protected:
+
+  using Configure = std::function<void(HazelcastConfig&)>;
+
+  HazelcastLocalCacheTest() {
+    makeCache();
+  }
+
+  // Recreates the cache on a new in-process backend. Partitions are 10
+  // bytes unless configure changes them.
+  void makeCache(const Configure& configure = nullptr) {
+    HazelcastConfig cfg;
+    cfg.set_body_partition_size(10);
+    if (configure) {
+      configure(cfg);
+    }
+    auto backend = std::make_unique<FaultInjectingStorageBackend>();
+    backend_ = backend.get();
+    hz_cache_ptr = std::make_unique<HazelcastHttpCache>(cfg,
+        std::move(backend));
+  }
+
+  Http::TestHeaderMapImpl responseHeaders() {
+    return Http::TestHeaderMapImpl{
+      {"date", formatter_.fromTime(current_time_)},
+      {"cache-control", "public, max-age=3600"}};
+  }
+
+  // Header entry stored for the path, without going through the cache.
+  HazelcastHeaderPtr storedHeader(absl::string_view path) {
+    HazelcastHeaderPtr header_entry;
+    backend_->getHeader(stableHashKey(makeLookupRequest(path).key()),
+        [&header_entry](HazelcastHeaderPtr&& entry) {
+      header_entry = std::move(entry);
+    });
+    return header_entry;
+  }
+
+  FaultInjectingStorageBackend* backend_;
+};
+
+void enableGzip(HazelcastConfig& cfg, uint32_t min_size = 0) {
+  cfg.mutable_body_compression()->set_codec(BodyCompressionConfig::GZIP);
+  cfg.mutable_body_compression()->set_min_size(min_size);
+}
+
+std::string gunzip(const std::string& compressed) {
+  z_stream zstream{};
+  EXPECT_EQ(Z_OK, inflateInit2(&zstream, 31));
+  zstream.next_in = reinterpret_cast<Bytef*>(
+      const_cast<char*>(compressed.data()));
+  zstream.avail_in = compressed.size();
+  std::string output;
+  char chunk[1024];
+  int result;
+  do {
+    zstream.next_out = reinterpret_cast<Bytef*>(chunk);
+    zstream.avail_out = sizeof(chunk);
+    result = inflate(&zstream, Z_NO_FLUSH);
+    output.append(chunk, sizeof(chunk) - zstream.avail_out);
+  } while (result == Z_OK);
+  EXPECT_EQ(Z_STREAM_END, result);
+  EXPECT_EQ(0, zstream.avail_in);
+  inflateEnd(&zstream);
+  return output;
+}
+
+TEST_F(HazelcastLocalCacheTest, PutGet) {
+  LookupContextPtr name_lookup_context = lookup("Name");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+
+  insert(move(name_lookup_context), responseHeaders(), "Value");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("Name").get(), "Value"));
+  EXPECT_EQ(1, backend_->headerCount());
+  EXPECT_EQ(1, backend_->bodyCount());
+}
+
+TEST_F(HazelcastLocalCacheTest, MultiplePartitions) {
+  const std::string body("0123456789abcdefghijABCDEFGHIJxyz");
+  insert("/partitions", responseHeaders(), body);
+  EXPECT_EQ(4, backend_->bodyCount());
+
+  LookupContextPtr context = lookup("/partitions");
+  EXPECT_EQ(body.size(), lookup_result_.content_length_);
+  EXPECT_EQ(body, getBody(*context, 0, body.size()));
+  EXPECT_EQ(body.substr(5, 20), getBody(*context, 5, 25));
+  EXPECT_EQ(body.substr(3, 4), getBody(*context, 3, 7));
+  EXPECT_EQ(body.substr(12, 6), getBody(*context, 12, 18));
+  EXPECT_EQ(body.substr(30), getBody(*context, 30, body.size()));
+}
+
+TEST_F(HazelcastLocalCacheTest, StreamingPut) {
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/stream"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertBody(Buffer::OwnedImpl("Hello, "),
+      [](bool ready){ EXPECT_TRUE(ready); }, false);
+  inserter->insertBody(Buffer::OwnedImpl("World!"),
+      [](bool ready){ EXPECT_TRUE(ready); }, true);
+  LookupContextPtr context = lookup("/stream");
+  EXPECT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  ASSERT_EQ(13, lookup_result_.content_length_);
+  EXPECT_EQ("Hello, World!", getBody(*context, 0, 13));
+}
+
+// A failed partition insert must not leave a header pointing
+// to an incomplete body.
+TEST_F(HazelcastLocalCacheTest, FailedWritesSkipHeader) {
+  StorageFaults failing_writes;
+  failing_writes.write_failure_rate = 1;
+  backend_->setFaults(failing_writes);
+
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/fail"));
+  inserter->insertHeaders(responseHeaders(), false);
+  bool ready = true;
+  inserter->insertBody(Buffer::OwnedImpl("0123456789abcdef"),
+      [&ready](bool ready_for_next) { ready = ready_for_next; }, false);
+  EXPECT_FALSE(ready);
+  inserter->insertBody(Buffer::OwnedImpl("ghij"), nullptr, true);
+
+  EXPECT_EQ(0, backend_->headerCount());
+  lookup("/fail");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+}
+
+TEST_F(HazelcastLocalCacheTest, FailedReadsAbortLookup) {
+  insert("/read", responseHeaders(), "0123456789abcdef");
+
+  StorageFaults failing_reads;
+  failing_reads.read_failure_rate = 1;
+  backend_->setFaults(failing_reads);
+  lookup("/read");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+
+  // Header is found but the body lookup fails.
+  backend_->setFaults(StorageFaults());
+  LookupContextPtr context = lookup("/read");
+  EXPECT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  backend_->setFaults(failing_reads);
+  bool aborted = false;
+  context->getBody(AdjustedByteRange(0, 10),
+      [&aborted](Buffer::InstancePtr&& data) { aborted = data == nullptr; });
+  EXPECT_TRUE(aborted);
+}
+
+TEST_F(HazelcastLocalCacheTest, InjectedLatency) {
+  StorageFaults latency;
+  latency.latency_us = 2000;
+  latency.jitter_us = 1000;
+  backend_->setFaults(latency);
+
+  insert("/latency", responseHeaders(), "Value");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/latency").get(), "Value"));
+
+  HazelcastOperationStats& stats = hz_cache_ptr->operationStats();
+  std::vector<uint64_t> latencies = stats.latencyPercentiles(
+      HazelcastOperation::LookupHeader, {0});
+  EXPECT_GE(latencies[0], 2000);
+  EXPECT_EQ(2, stats.completed(HazelcastOperation::LookupHeader));
+  EXPECT_EQ(0, stats.inFlight());
+
+  // Recorded per thread, merged on read.
+  std::thread([this]() { lookup("/latency"); }).join();
+  EXPECT_EQ(3, stats.completed(HazelcastOperation::LookupHeader));
+  latencies = stats.latencyPercentiles(HazelcastOperation::LookupHeader,
+      {0});
+  EXPECT_GE(latencies[0], 2000);
+}
+
+TEST_F(HazelcastLocalCacheTest, ConcurrentInsertsAndLookups) {
+  const int thread_count = 8;
+  const int keys_per_thread = 50;
+  const std::string date = formatter_.fromTime(current_time_);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([this, t, &date]() {
+      Http::TestHeaderMapImpl request_headers{{":method", "GET"},
+        {":path", "/"}, {"host", "example.com"},
+        {"x-forwarded-proto", "https"}};
+      Http::TestHeaderMapImpl response_headers{{"date", date},
+        {"cache-control", "public, max-age=3600"}};
+      for (int i = 0; i < keys_per_thread; i++) {
+        std::string path = absl::StrCat("/", t, "/", i);
+        std::string body(i + 1, static_cast<char>('a' + t));
+        request_headers.setPath(path);
+        LookupContextPtr context = hz_cache_ptr->makeLookupContext(
+            LookupRequest(request_headers, current_time_));
+        context->getHeaders([](LookupResult&&) {});
+        InsertContextPtr inserter =
+            hz_cache_ptr->makeInsertContext(std::move(context));
+        inserter->insertHeaders(response_headers, false);
+        inserter->insertBody(Buffer::OwnedImpl(body), nullptr, true);
+
+        context = hz_cache_ptr->makeLookupContext(
+            LookupRequest(request_headers, current_time_));
+        uint64_t content_length = 0;
+        context->getHeaders([&content_length](LookupResult&& result) {
+          content_length = result.content_length_;
+        });
+        EXPECT_EQ(body.size(), content_length);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(thread_count * keys_per_thread, backend_->headerCount());
+}
+
+TEST_F(HazelcastLocalCacheTest, CompressedBody) {
+  makeCache([](HazelcastConfig& cfg) { enableGzip(cfg); });
+  const std::string body = R"({"items": [{"id": 1, "name": "item"}, )"
+      R"({"id": 2, "name": "item"}, {"id": 3, "name": "item"}]})";
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("content-type", "application/json");
+  insert("/json", response_headers, body);
+  EXPECT_EQ(HazelcastBodyCodec::Gzip, storedHeader("/json")->body_codec);
+
+  // Decompressed for clients not accepting gzip.
+  LookupContextPtr context = lookup("/json");
+  ASSERT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  EXPECT_EQ(body.size(), lookup_result_.content_length_);
+  EXPECT_EQ(nullptr, lookup_result_.headers_->ContentEncoding());
+  EXPECT_EQ(body, getBody(*context, 0, body.size()));
+  EXPECT_EQ(body.substr(13, 20), getBody(*context, 13, 33));
+  EXPECT_EQ(body.substr(3, 4), getBody(*context, 3, 7));
+}
+
+TEST_F(HazelcastLocalCacheTest, CompressedBodyServedAsIs) {
+  makeCache([](HazelcastConfig& cfg) { enableGzip(cfg); });
+  const std::string body(95, 'z');
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("content-type", "text/html; charset=utf-8");
+  response_headers.addCopy("etag", "\"v1\"");
+  insert("/html", response_headers, body);
+
+  request_headers_.addCopy("accept-encoding", "br, gzip");
+  LookupContextPtr context = lookup("/html");
+  ASSERT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  const Http::HeaderMap& headers = *lookup_result_.headers_;
+  EXPECT_EQ("gzip", headers.ContentEncoding()->value().getStringView());
+  EXPECT_EQ("Accept-Encoding", headers.Vary()->value().getStringView());
+  EXPECT_EQ("W/\"v1\"", headers.Etag()->value().getStringView());
+  EXPECT_EQ(std::to_string(lookup_result_.content_length_),
+      headers.ContentLength()->value().getStringView());
+  EXPECT_EQ(body, gunzip(getBody(*context, 0,
+      lookup_result_.content_length_)));
+
+  // Ranges are served from the decompressed body.
+  request_headers_.addCopy("range", "bytes=10-19");
+  context = lookup("/html");
+  EXPECT_EQ(nullptr, lookup_result_.headers_->ContentEncoding());
+  EXPECT_EQ(body.substr(10, 10), getBody(*context, 10, 20));
+}
+
+TEST_F(HazelcastLocalCacheTest, IdentityRepresentation) {
+  makeCache([](HazelcastConfig& cfg) {
+    enableGzip(cfg);
+    cfg.mutable_body_compression()->set_store_identity(true);
+  });
+  const std::string body = R"({"items": [{"id": 1, "name": "item"}, )"
+      R"({"id": 2, "name": "item"}, {"id": 3, "name": "item"}]})";
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("content-type", "application/json");
+  insert("/json", response_headers, body);
+
+  HazelcastHeaderPtr entry = storedHeader("/json");
+  EXPECT_EQ(HazelcastBodyCodec::Gzip, entry->body_codec);
+  ASSERT_EQ(1, entry->representations.size());
+  EXPECT_EQ(HazelcastBodyCodec::None, entry->representations[0].codec);
+  const size_t partitions = entry->encoded_partition_sizes.size();
+  EXPECT_EQ(partitions, entry->representations[0].partition_sizes.size());
+  EXPECT_EQ(2 * partitions, backend_->bodyCount());
+
+  // Served from the uncompressed partitions.
+  LookupContextPtr context = lookup("/json");
+  EXPECT_EQ(body.size(), lookup_result_.content_length_);
+  EXPECT_EQ(nullptr, lookup_result_.headers_->ContentEncoding());
+  EXPECT_EQ(body, getBody(*context, 0, body.size()));
+  EXPECT_EQ(body.substr(13, 20), getBody(*context, 13, 33));
+
+  // And from the compressed ones to clients accepting gzip.
+  request_headers_.addCopy("accept-encoding", "gzip");
+  context = lookup("/json");
+  EXPECT_EQ("gzip",
+      lookup_result_.headers_->ContentEncoding()->value().getStringView());
+  EXPECT_EQ(body, gunzip(getBody(*context, 0,
+      lookup_result_.content_length_)));
+}
+
+TEST_F(HazelcastLocalCacheTest, CompressionSkipped) {
+  makeCache([](HazelcastConfig& cfg) { enableGzip(cfg, 50); });
+  Http::TestHeaderMapImpl text = responseHeaders();
+  text.addCopy("content-type", "text/plain");
+  Http::TestHeaderMapImpl image = responseHeaders();
+  image.addCopy("content-type", "image/png");
+  Http::TestHeaderMapImpl encoded = responseHeaders();
+  encoded.addCopy("content-type", "text/plain");
+  encoded.addCopy("content-encoding", "br");
+
+  insert("/small", text, std::string(20, 'a'));
+  insert("/image", image, std::string(100, 'a'));
+  insert("/encoded", encoded, std::string(100, 'a'));
+  insert("/large", text, std::string(100, 'a'));
+  EXPECT_EQ(HazelcastBodyCodec::None, storedHeader("/small")->body_codec);
+  EXPECT_EQ(HazelcastBodyCodec::None, storedHeader("/image")->body_codec);
+  EXPECT_EQ(HazelcastBodyCodec::None, storedHeader("/encoded")->body_codec);
+  EXPECT_EQ(HazelcastBodyCodec::Gzip, storedHeader("/large")->body_codec);
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/small").get(),
+      std::string(20, 'a')));
+}
+
+TEST_F(HazelcastLocalCacheTest, DeduplicatedBodies) {
+  makeCache([](HazelcastConfig& cfg) { cfg.set_deduplicate_bodies(true); });
+  const std::string body("0123456789abcdefghijABCDEFGHIJxyz");
+  insert("/a?utm_source=x", responseHeaders(), body);
+  EXPECT_EQ(4, backend_->bodyCount());
+  insert("/a?utm_source=y", responseHeaders(), body);
+  EXPECT_EQ(4, backend_->bodyCount());
+  EXPECT_EQ(2, backend_->headerCount());
+  EXPECT_EQ(4, storedHeader("/a?utm_source=y")->partition_keys.size());
+
+  // Shares the first two partitions only.
+  const std::string other("0123456789abcdefghij--------------");
+  insert("/b", responseHeaders(), other);
+  EXPECT_EQ(6, backend_->bodyCount());
+
+  LookupContextPtr context = lookup("/a?utm_source=x");
+  EXPECT_EQ(body, getBody(*context, 0, body.size()));
+  EXPECT_EQ(body.substr(12, 6), getBody(*context, 12, 18));
+  context = lookup("/b");
+  EXPECT_EQ(other, getBody(*context, 0, other.size()));
+}
+
+TEST_F(HazelcastLocalCacheTest, DeduplicatedCompressedBodies) {
+  makeCache([](HazelcastConfig& cfg) {
+    enableGzip(cfg);
+    cfg.set_deduplicate_bodies(true);
+  });
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("content-type", "text/plain");
+  const std::string body(45, 'c');
+  insert("/c1", response_headers, body);
+  const size_t body_count = backend_->bodyCount();
+  insert("/c2", response_headers, body);
+  EXPECT_EQ(body_count, backend_->bodyCount());
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/c2").get(), body));
+}
+
+TEST_F(HazelcastLocalCacheTest, GeometricPartitions) {
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_partition_schedule()->set_first_size(4);
+    cfg.mutable_partition_schedule()->set_growth_factor(2);
+    cfg.mutable_partition_schedule()->set_max_size(16);
+  });
+
+  // Partitions: [0, 4) [4, 12) [12, 28) [28, 44) [44, 50)
+  std::string body;
+  for (int i = 0; i < 50; i++) {
+    body.push_back('a' + i % 26);
+  }
+  insert("/geometric", responseHeaders(), body);
+  EXPECT_EQ(5, backend_->bodyCount());
+
+  LookupContextPtr context = lookup("/geometric");
+  EXPECT_EQ(body, getBody(*context, 0, body.size()));
+  EXPECT_EQ(body.substr(0, 3), getBody(*context, 0, 3));
+  EXPECT_EQ(body.substr(5, 6), getBody(*context, 5, 11));
+  EXPECT_EQ(body.substr(10, 25), getBody(*context, 10, 35));
+  EXPECT_EQ(body.substr(44), getBody(*context, 44, 50));
+}
+
+TEST_F(HazelcastLocalCacheTest, InvalidPartitionSchedule) {
+  EXPECT_THROW(makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_partition_schedule()->set_first_size(0);
+    cfg.mutable_partition_schedule()->set_growth_factor(2);
+    cfg.mutable_partition_schedule()->set_max_size(16);
+  }), EnvoyException);
+  // max_size not set.
+  EXPECT_THROW(makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_partition_schedule()->set_first_size(4);
+    cfg.mutable_partition_schedule()->set_growth_factor(2);
+  }), EnvoyException);
+  EXPECT_THROW(makeCache([](HazelcastConfig& cfg) {
+    cfg.set_body_partition_size(-1);
+  }), EnvoyException);
+}
+
+TEST_F(HazelcastLocalCacheTest, LegacyEntryFormat) {
+  makeCache([](HazelcastConfig& cfg) { cfg.set_legacy_entry_format(true); });
+  const std::string body("0123456789abcdefghijxyz");
+  insert("/legacy", responseHeaders(), body);
+  EXPECT_EQ(3, backend_->bodyCount());
+  HazelcastHeaderPtr header_entry = storedHeader("/legacy");
+  EXPECT_TRUE(header_entry->legacyFormat());
+  // Read with the configured partition size, as the admin page reports.
+  EXPECT_EQ(3, hz_cache_ptr->entrySchedule(*header_entry).count(
+      header_entry->total_body_size));
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/legacy").get(), body));
+
+  // Not representable in the legacy format.
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("vary", "Accept-Language");
+  insert("/vary", response_headers, "Value");
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/trailers"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertBody(Buffer::OwnedImpl(body), nullptr, false);
+  inserter->insertTrailers(Http::TestHeaderMapImpl{{"grpc-status", "0"}});
+  EXPECT_EQ(1, backend_->headerCount());
+  EXPECT_EQ(3, backend_->bodyCount());
+  EXPECT_EQ(2, hz_cache_ptr->insertStats().skipped(
+      HazelcastInsertSkip::LegacyFormat));
+
+  EXPECT_THROW(makeCache([](HazelcastConfig& cfg) {
+    cfg.set_legacy_entry_format(true);
+    enableGzip(cfg);
+  }), EnvoyException);
+  EXPECT_THROW(makeCache([](HazelcastConfig& cfg) {
+    cfg.set_legacy_entry_format(true);
+    cfg.set_deduplicate_bodies(true);
+  }), EnvoyException);
+}
+
+TEST_F(HazelcastLocalCacheTest, PrecomputedFreshness) {
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("etag", "\"v1\"");
+  response_headers.addCopy("last-modified", "Sun, 18 Oct 2026 08:30:00 GMT");
+  response_headers.addCopy("vary", "Accept-Language, User-Agent");
+  insert("/fresh", response_headers, "Value");
+
+  HazelcastHeaderPtr entry = storedHeader("/fresh");
+  ASSERT_TRUE(entry->freshness);
+  EXPECT_EQ(std::chrono::duration_cast<std::chrono::seconds>(
+      current_time_.time_since_epoch()).count(),
+      entry->freshness->response_time);
+  EXPECT_EQ(3600, entry->freshness->freshness_lifetime);
+  EXPECT_EQ("\"v1\"", entry->freshness->etag);
+  EXPECT_EQ("Sun, 18 Oct 2026 08:30:00 GMT", entry->freshness->last_modified);
+  EXPECT_EQ(std::vector<std::string>({"accept-language", "user-agent"}),
+      entry->freshness->vary);
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/fresh").get(), "Value"));
+
+  current_time_ += std::chrono::seconds(3601);
+  lookup("/fresh");
+  EXPECT_EQ(CacheEntryStatus::RequiresValidation,
+      lookup_result_.cache_entry_status_);
+  // Only the validators of a stale entry are returned.
+  EXPECT_EQ("\"v1\"", lookup_result_.headers_->Etag()->value()
+      .getStringView());
+  EXPECT_EQ(2, lookup_result_.headers_->size());
+
+  // No Cache-Control, as LookupRequest::makeLookupResult decides.
+  insert("/no-cache-control",
+      Http::TestHeaderMapImpl{{"date", formatter_.fromTime(current_time_)}},
+      "Value");
+  EXPECT_EQ(-1, storedHeader("/no-cache-control")->freshness->
+      freshness_lifetime);
+  lookup("/no-cache-control");
+  EXPECT_EQ(CacheEntryStatus::RequiresValidation,
+      lookup_result_.cache_entry_status_);
+}
+
+TEST_F(HazelcastLocalCacheTest, VaryVariants) {
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("vary", "Accept-Language");
+
+  request_headers_.addCopy("accept-language", "en, de;q=0.5");
+  insert("/vary", response_headers, "English");
+  request_headers_.remove(Http::LowerCaseString("accept-language"));
+  request_headers_.addCopy("accept-language", "de");
+  lookup("/vary");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+  insert("/vary", response_headers, "Deutsch");
+
+  // Vary spec and two variants.
+  EXPECT_EQ(3, backend_->headerCount());
+  EXPECT_EQ(std::vector<std::string>({"accept-language"}),
+      storedHeader("/vary")->vary_spec);
+
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/vary").get(), "Deutsch"));
+  request_headers_.remove(Http::LowerCaseString("accept-language"));
+  // Same value after normalization.
+  request_headers_.addCopy("accept-language", "EN,de; q=0.5");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/vary").get(), "English"));
+  request_headers_.remove(Http::LowerCaseString("accept-language"));
+  lookup("/vary");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+}
+
+TEST_F(HazelcastLocalCacheTest, VaryNotAllowed) {
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("vary", "User-Agent");
+  insert("/user-agent", response_headers, "Value");
+  response_headers.remove(Http::LowerCaseString("vary"));
+  response_headers.addCopy("vary", "*");
+  insert("/any", response_headers, "Value");
+  EXPECT_EQ(0, backend_->headerCount());
+  EXPECT_EQ(0, backend_->bodyCount());
+}
+
+// As the filter does, through the overload not taking the headers.
+TEST_F(HazelcastLocalCacheTest, VaryWithoutRequestHeaders) {
+  auto lookupWithoutHeaders = [this](absl::string_view path) {
+    LookupContextPtr context =
+        hz_cache_ptr->makeLookupContext(makeLookupRequest(path));
+    context->getHeaders([this](LookupResult&& result) {
+      lookup_result_ = std::move(result);
+    });
+    return context;
+  };
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.addCopy("vary", "Accept-Language");
+
+  request_headers_.addCopy("accept-language", "en");
+  insert(lookupWithoutHeaders("/vary"), response_headers, "English");
+  EXPECT_EQ(0, backend_->headerCount());
+  EXPECT_EQ(0, backend_->bodyCount());
+
+  insert("/vary", response_headers, "English");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/vary").get(), "English"));
+  request_headers_.remove(Http::LowerCaseString("accept-language"));
+  request_headers_.addCopy("accept-language", "de");
+  // Not the English variant, whatever the request accepts.
+  lookupWithoutHeaders("/vary");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+
+  // Responses without Vary are found either way.
+  insert("/plain", responseHeaders(), "Value");
+  EXPECT_TRUE(expectLookupSuccessWithBody(
+      lookupWithoutHeaders("/plain").get(), "Value"));
+}
+
+TEST_F(HazelcastLocalCacheTest, HeaderOnlyRequests) {
+  const std::string body("0123456789abcdefghijABCDEFGHIJxyz");
+  Http::TestHeaderMapImpl response_headers = responseHeaders();
+  response_headers.setStatus(200);
+  response_headers.addCopy("etag", "\"v1\"");
+  response_headers.addCopy("last-modified", "Sun, 18 Oct 2026 08:30:00 GMT");
+  response_headers.addCopy("content-length", std::to_string(body.size()));
+  insert("/conditional", response_headers, body);
+  const uint64_t body_lookups = hz_cache_ptr->operationStats().completed(
+      HazelcastOperation::LookupBody);
+
+  request_headers_.setMethod("HEAD");
+  lookup("/conditional");
+  EXPECT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  EXPECT_EQ(0, lookup_result_.content_length_);
+  EXPECT_EQ("200", lookup_result_.headers_->Status()->value().getStringView());
+  EXPECT_EQ(std::to_string(body.size()),
+      lookup_result_.headers_->ContentLength()->value().getStringView());
+
+  request_headers_.setMethod("GET");
+  request_headers_.addCopy("if-none-match", "\"v0\", W/\"v1\"");
+  lookup("/conditional");
+  EXPECT_EQ(0, lookup_result_.content_length_);
+  EXPECT_EQ("304", lookup_result_.headers_->Status()->value().getStringView());
+  request_headers_.remove(Http::LowerCaseString("if-none-match"));
+
+  request_headers_.addCopy("if-modified-since",
+      "Sun, 18 Oct 2026 08:30:00 GMT");
+  lookup("/conditional");
+  EXPECT_EQ("304", lookup_result_.headers_->Status()->value().getStringView());
+  request_headers_.remove(Http::LowerCaseString("if-modified-since"));
+
+  // Modified since, hence the full response.
+  request_headers_.addCopy("if-modified-since",
+      "Sat, 17 Oct 2026 08:30:00 GMT");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/conditional").get(), body));
+  EXPECT_EQ("200", lookup_result_.headers_->Status()->value().getStringView());
+
+  // Only the last lookup fetched the body.
+  EXPECT_EQ(body_lookups + 4, hz_cache_ptr->operationStats().completed(
+      HazelcastOperation::LookupBody));
+
+  // Without the request headers the conditions are unknown, hence the
+  // full response.
+  request_headers_.remove(Http::LowerCaseString("if-modified-since"));
+  request_headers_.addCopy("if-none-match", "\"v1\"");
+  LookupContextPtr context =
+      hz_cache_ptr->makeLookupContext(makeLookupRequest("/conditional"));
+  context->getHeaders([this](LookupResult&& result) {
+    lookup_result_ = std::move(result);
+  });
+  EXPECT_TRUE(expectLookupSuccessWithBody(context.get(), body));
+  EXPECT_EQ("200", lookup_result_.headers_->Status()->value().getStringView());
+}
+
+TEST_F(HazelcastLocalCacheTest, Trailers) {
+  const Http::TestHeaderMapImpl trailers{{"grpc-status", "0"},
+      {"grpc-message", "ok"}};
+  auto trailersOf = [](LookupContext& context) {
+    Http::HeaderMapPtr found;
+    context.getTrailers([&found](Http::HeaderMapPtr&& trailers) {
+      found = std::move(trailers);
+    });
+    return found;
+  };
+
+  // Body over two partitions, ended by the trailers.
+  const std::string body("0123456789abcdefghij");
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/trailers"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertBody(Buffer::OwnedImpl(body), nullptr, false);
+  EXPECT_EQ(0, backend_->headerCount());
+  inserter->insertTrailers(trailers);
+  EXPECT_TRUE(storedHeader("/trailers")->hasTrailers());
+
+  LookupContextPtr context = lookup("/trailers");
+  EXPECT_TRUE(lookup_result_.has_trailers_);
+  EXPECT_TRUE(expectLookupSuccessWithBody(context.get(), body));
+  Http::HeaderMapPtr found = trailersOf(*context);
+  ASSERT_TRUE(found);
+  EXPECT_EQ(2, found->size());
+  EXPECT_EQ("0", found->get(Http::LowerCaseString("grpc-status"))->value()
+      .getStringView());
+
+  // No body at all.
+  inserter = hz_cache_ptr->makeInsertContext(lookup("/no-body"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertTrailers(trailers);
+  context = lookup("/no-body");
+  EXPECT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  EXPECT_EQ(0, lookup_result_.content_length_);
+  EXPECT_TRUE(lookup_result_.has_trailers_);
+  EXPECT_TRUE(trailersOf(*context));
+
+  insert("/no-trailers", responseHeaders(), "Value");
+  context = lookup("/no-trailers");
+  EXPECT_FALSE(lookup_result_.has_trailers_);
+  EXPECT_TRUE(expectLookupSuccessWithBody(context.get(), "Value"));
+  EXPECT_FALSE(trailersOf(*context));
+}
+
+TEST_F(HazelcastLocalCacheTest, PooledPartitionBuffers) {
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_buffer_pool()->set_max_idle_buffers(2);
+  });
+  const HazelcastBufferPool& pool = hz_cache_ptr->bufferPool();
+
+  const std::string body("0123456789abcdefghijklmnopqrstuvwxyz");
+  insert("/pooled", responseHeaders(), body);
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/pooled").get(), body));
+  insert("/pooled-again", responseHeaders(), body);
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/pooled-again").get(),
+      body));
+
+  // A buffer per partition, reused from the second partition on.
+  EXPECT_EQ(0, pool.buffersInUse());
+  EXPECT_EQ(1, pool.misses());
+  EXPECT_EQ(7, pool.hits());
+  EXPECT_EQ(1, pool.idleBuffers());
+
+  // A response not completed returns its buffer too.
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/incomplete"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertBody(Buffer::OwnedImpl("01234"), nullptr, false);
+  EXPECT_EQ(1, pool.buffersInUse());
+  inserter.reset();
+  EXPECT_EQ(0, pool.buffersInUse());
+  EXPECT_EQ(1, pool.idleBuffers());
+}
+
+TEST_F(HazelcastLocalCacheTest, WriteBehind) {
+  // Written on flush() only.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_write_behind()->set_max_queued_bytes(100);
+    cfg.mutable_write_behind()->set_max_batch_bytes(1000);
+    cfg.mutable_write_behind()->set_max_delay_ms(3600 * 1000);
+  });
+  HazelcastWriteBehindQueue* queue = hz_cache_ptr->writeBehind();
+  ASSERT_NE(nullptr, queue);
+
+  const std::string body("0123456789abcdefghijklmnopqrstuvwxyz");
+  insert("/queued", responseHeaders(), body);
+  EXPECT_EQ(1, queue->queuedInserts());
+  EXPECT_EQ(body.size(), queue->queuedBytes());
+  EXPECT_EQ(0, backend_->bodyCount());
+  EXPECT_EQ(0, backend_->headerCount());
+  queue->flush();
+  EXPECT_EQ(0, queue->queuedInserts());
+  EXPECT_EQ(1, queue->committed());
+  EXPECT_EQ(4, backend_->bodyCount());
+  // One batch of partitions, then one of headers.
+  EXPECT_EQ(2, queue->batches());
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/queued").get(), body));
+
+  // Larger than the queue of the worker, aborted while streaming.
+  insert("/large", responseHeaders(), std::string(101, 'x'));
+  EXPECT_EQ(1, hz_cache_ptr->insertStats().skipped(
+      HazelcastInsertSkip::QueueLimit));
+  EXPECT_EQ(0, queue->dropped());
+  EXPECT_EQ(0, queue->queuedInserts());
+
+  // Fits alone, but not besides another queued response.
+  insert("/first", responseHeaders(), std::string(60, 'x'));
+  insert("/second", responseHeaders(), std::string(60, 'x'));
+  EXPECT_EQ(1, queue->dropped());
+  EXPECT_EQ(1, queue->queuedInserts());
+  queue->flush();
+
+  // Not committed if a partition fails.
+  insert("/failing", responseHeaders(), body);
+  StorageFaults failing_writes;
+  failing_writes.write_failure_rate = 1;
+  backend_->setFaults(failing_writes);
+  queue->flush();
+  backend_->setFaults(StorageFaults());
+  EXPECT_EQ(1, queue->failed());
+  EXPECT_EQ(2, backend_->headerCount());
+  lookup("/failing");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+
+  // Of two responses for the same key flushed together, the later one
+  // is committed with its own partitions, the other is not written.
+  const std::string replacing(25, 'r');
+  insert("/same", responseHeaders(), body);
+  insert("/same", responseHeaders(), replacing);
+  EXPECT_EQ(2, queue->queuedInserts());
+  queue->flush();
+  EXPECT_EQ(1, queue->superseded());
+  EXPECT_EQ(3, queue->committed());
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/same").get(), replacing));
+}
+
+TEST_F(HazelcastLocalCacheTest, AdmissionOnSecondMiss) {
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_admission()->set_min_requests(2);
+  });
+
+  insert("/admitted", responseHeaders(), "Value");
+  EXPECT_EQ(0, backend_->headerCount());
+  EXPECT_EQ(0, backend_->bodyCount());
+  lookup("/admitted");
+  EXPECT_EQ(CacheEntryStatus::Unusable, lookup_result_.cache_entry_status_);
+  insert("/admitted", responseHeaders(), "Value");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/admitted").get(),
+      "Value"));
+  EXPECT_EQ(1, hz_cache_ptr->admissionFilter().admitted());
+  EXPECT_EQ(1, hz_cache_ptr->admissionFilter().rejected());
+
+  // Misses through another Envoy count once synced with the storage,
+  // as with the cluster.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_admission()->set_min_requests(3);
+    cfg.mutable_admission()->set_shared_map_name("admission");
+    cfg.mutable_admission()->set_shared_sync_interval_ms(60000);
+  });
+  HazelcastAdmissionFilter& admission = hz_cache_ptr->admissionFilter();
+  EXPECT_TRUE(admission.shared());
+  backend_->addRequestCount(stableHashKey(makeLookupRequest("/shared").key()),
+      2, [](uint64_t) {});
+  insert("/shared", responseHeaders(), "Value");
+  EXPECT_EQ(0, backend_->headerCount());
+  admission.syncShared(*backend_);
+  insert("/shared", responseHeaders(), "Value");
+  EXPECT_EQ(1, backend_->headerCount());
+}
+
+TEST_F(HazelcastLocalCacheTest, MaxObjectSize) {
+  makeCache([](HazelcastConfig& cfg) { cfg.set_max_object_size(25); });
+  HazelcastInsertStats& stats = hz_cache_ptr->insertStats();
+
+  Http::TestHeaderMapImpl headers = responseHeaders();
+  headers.addCopy("content-length", "26");
+  insert("/too-large", headers, std::string(26, 'x'));
+  EXPECT_EQ(0, backend_->bodyCount());
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::TooLarge));
+
+  // Without Content-Length, aborted once the body exceeds the limit.
+  InsertContextPtr inserter =
+      hz_cache_ptr->makeInsertContext(lookup("/growing"));
+  inserter->insertHeaders(responseHeaders(), false);
+  inserter->insertBody(Buffer::OwnedImpl("0123456789abcdef"), nullptr, false);
+  EXPECT_EQ(1, backend_->bodyCount());
+  bool ready = true;
+  inserter->insertBody(Buffer::OwnedImpl("ghijklmnopqr"),
+      [&ready](bool ready_for_next) { ready = ready_for_next; }, false);
+  EXPECT_FALSE(ready);
+  inserter->insertBody(Buffer::OwnedImpl("st"), nullptr, true);
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::AbortedTooLarge));
+  // The partition written before is removed.
+  EXPECT_EQ(0, backend_->bodyCount());
+  EXPECT_EQ(0, backend_->headerCount());
+
+  const std::string body(25, 'y');
+  insert("/at-limit", responseHeaders(), body);
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/at-limit").get(), body));
+}
+
+TEST_F(HazelcastLocalCacheTest, InsertMemoryBudget) {
+  makeCache([](HazelcastConfig& cfg) { cfg.set_max_insert_memory(15); });
+  const HazelcastMemoryBudget& budget = hz_cache_ptr->memoryBudget();
+  HazelcastInsertStats& stats = hz_cache_ptr->insertStats();
+
+  // Released once a partition is written.
+  InsertContextPtr first = hz_cache_ptr->makeInsertContext(lookup("/first"));
+  first->insertHeaders(responseHeaders(), false);
+  first->insertBody(Buffer::OwnedImpl("0123456789"), nullptr, false);
+  EXPECT_EQ(0, budget.used());
+  InsertContextPtr second =
+      hz_cache_ptr->makeInsertContext(lookup("/second"));
+  second->insertHeaders(responseHeaders(), false);
+  second->insertBody(Buffer::OwnedImpl("0123456789ab"), nullptr, false);
+  EXPECT_EQ(2, budget.used());
+  EXPECT_EQ(2, backend_->bodyCount());
+  first->insertBody(Buffer::OwnedImpl("abcdefgh"), nullptr, false);
+  EXPECT_EQ(10, budget.used());
+
+  // In flight, aborted once its bytes do not fit.
+  bool ready = true;
+  second->insertBody(Buffer::OwnedImpl("cdefgh"),
+      [&ready](bool ready_for_next) { ready = ready_for_next; }, false);
+  EXPECT_FALSE(ready);
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::AbortedMemoryBudget));
+  EXPECT_EQ(1, backend_->bodyCount());
+  EXPECT_EQ(8, budget.used());
+
+  // Refused before staging anything.
+  insert("/third", responseHeaders(), "0123456789");
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::MemoryBudget));
+  EXPECT_EQ(8, budget.used());
+
+  first->insertBody(Buffer::OwnedImpl("i"), nullptr, true);
+  EXPECT_EQ(0, budget.used());
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/first").get(),
+      "0123456789abcdefghi"));
+}
+
+TEST_F(HazelcastLocalCacheTest, InsertMemoryBudgetQueuedAndPooled) {
+  // Queued responses stay reserved until written or dropped.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.set_max_insert_memory(25);
+    cfg.mutable_write_behind()->set_max_queued_bytes(15);
+    cfg.mutable_write_behind()->set_max_delay_ms(3600 * 1000);
+  });
+  const HazelcastMemoryBudget* budget = &hz_cache_ptr->memoryBudget();
+  HazelcastWriteBehindQueue* queue = hz_cache_ptr->writeBehind();
+  insert("/queued", responseHeaders(), "0123456789ab");
+  EXPECT_EQ(1, queue->queuedInserts());
+  EXPECT_EQ(12, budget->used());
+  insert("/dropped", responseHeaders(), "0123456789ab");
+  EXPECT_EQ(1, queue->dropped());
+  EXPECT_EQ(12, budget->used());
+  queue->flush();
+  EXPECT_EQ(0, budget->used());
+  EXPECT_EQ(1, backend_->headerCount());
+
+  // Pooled buffers are acquired at the size of their partition, hence
+  // reserved whole.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.set_max_insert_memory(15);
+    cfg.mutable_buffer_pool()->set_max_idle_buffers(1);
+  });
+  budget = &hz_cache_ptr->memoryBudget();
+  InsertContextPtr first = hz_cache_ptr->makeInsertContext(lookup("/first"));
+  first->insertHeaders(responseHeaders(), false);
+  first->insertBody(Buffer::OwnedImpl("012"), nullptr, false);
+  EXPECT_EQ(10, budget->used());
+  first->insertBody(Buffer::OwnedImpl("3456"), nullptr, false);
+  EXPECT_EQ(10, budget->used());
+  insert("/second", responseHeaders(), "0");
+  EXPECT_EQ(1, hz_cache_ptr->insertStats().skipped(
+      HazelcastInsertSkip::MemoryBudget));
+  first->insertBody(Buffer::OwnedImpl("789"), nullptr, true);
+  EXPECT_EQ(0, budget->used());
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/first").get(),
+      "0123456789"));
+}
+
+TEST_F(HazelcastLocalCacheTest, InsertRateLimit) {
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_insert_rate_limit()->set_bytes_per_second(15);
+  });
+  HazelcastInsertStats& stats = hz_cache_ptr->insertStats();
+
+  // The bucket starts full, the second partition does not fit.
+  InsertContextPtr growing =
+      hz_cache_ptr->makeInsertContext(lookup("/growing"));
+  growing->insertHeaders(responseHeaders(), false);
+  growing->insertBody(Buffer::OwnedImpl("0123456789ab"), nullptr, false);
+  EXPECT_EQ(1, backend_->bodyCount());
+  bool ready = true;
+  growing->insertBody(Buffer::OwnedImpl("cdefghijkl"),
+      [&ready](bool ready_for_next) { ready = ready_for_next; }, false);
+  EXPECT_FALSE(ready);
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::AbortedRateLimited));
+  EXPECT_EQ(0, backend_->bodyCount());
+
+  insert("/refused", responseHeaders(), "0123456789");
+  EXPECT_EQ(1, stats.skipped(HazelcastInsertSkip::RateLimited));
+  EXPECT_EQ(0, backend_->headerCount());
+  insert("/small", responseHeaders(), "01234");
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/small").get(), "01234"));
+
+  // Summed on the storage, as on the cluster. At most one window ends
+  // between the inserts, so one of them exceeds the limit at least.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_insert_rate_limit()->set_bytes_per_second(15);
+    cfg.mutable_insert_rate_limit()->set_shared_map_name("insert_rate");
+  });
+  EXPECT_TRUE(hz_cache_ptr->rateLimiter().shared());
+  for (const std::string path : {"/x", "/y", "/z"}) {
+    insert(path, responseHeaders(), "0123456789");
+  }
+  EXPECT_GE(hz_cache_ptr->insertStats().skipped(
+      HazelcastInsertSkip::RateLimited), 1);
+  EXPECT_LE(backend_->headerCount(), 2);
+
+  // Limited by the write-behind queue when it writes the responses.
+  makeCache([](HazelcastConfig& cfg) {
+    cfg.mutable_insert_rate_limit()->set_bytes_per_second(15);
+    cfg.mutable_write_behind()->set_max_queued_bytes(100);
+    cfg.mutable_write_behind()->set_max_delay_ms(3600 * 1000);
+  });
+  HazelcastWriteBehindQueue* queue = hz_cache_ptr->writeBehind();
+  insert("/first", responseHeaders(), "0123456789ab");
+  insert("/second", responseHeaders(), "0123456789ab");
+  EXPECT_EQ(2, queue->queuedInserts());
+  queue->flush();
+  EXPECT_EQ(1, queue->rateLimited());
+  EXPECT_EQ(1, queue->committed());
+  EXPECT_EQ(1, backend_->headerCount());
+  EXPECT_EQ(2, backend_->bodyCount());
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,93 @@
+/**
+ * Heap allocations of body partition reads on the in-process storage
+ * backend. Creating the lookup context and reading the header entry
+ * are not measured. The allocation counter counts the allocations of the whole
+ * process, hence these tests have their own binary. Allocations of
+ * the Hazelcast client on a cluster are not covered.
+ */
+#include "hazelcast_allocation_counter.h"
+#include "hazelcast_http_cache_test_base.h"
+#include "hazelcast_local_backend.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+const uint64_t PARTITION_SIZE = 10;
+
+// Allocations of a body partition hit which the cache cannot avoid:
+// the storage callback wrapped by HazelcastHttpCache::lookupBody (1),
+// the entry created by the serializer (1), its byte array (2), the
+// shared pointer of the entry (1) and the buffer passed to the filter
+// with its slice (2). Keys and callbacks of the lookup context must
+// not add any.
+const uint64_t MAX_PARTITION_ALLOCATIONS = 7;
+
+class HazelcastLookupAllocationTest : public HazelcastHttpCacheTestBase {
+protected:
+  HazelcastLookupAllocationTest() {
+    HazelcastConfig cfg;
+    cfg.set_body_partition_size(PARTITION_SIZE);
+    hz_cache_ptr = std::make_unique<HazelcastHttpCache>(cfg,
+        std::make_unique<LocalStorageBackend>());
+  }
+
+  // Allocations made by getBody for each partition of the body.
+  std::vector<uint64_t> partitionAllocations(LookupContext& context,
+      uint64_t body_size) {
+    std::vector<uint64_t> allocations;
+    for (uint64_t begin = 0; begin < body_size; begin += PARTITION_SIZE) {
+      Buffer::InstancePtr chunk;
+      AllocationCounter counter;
+      context.getBody(AdjustedByteRange(begin,
+          std::min(begin + PARTITION_SIZE, body_size)),
+          [&chunk](Buffer::InstancePtr&& data) { chunk = std::move(data); });
+      allocations.push_back(counter.allocations());
+      EXPECT_TRUE(chunk);
+    }
+    return allocations;
+  }
+};
+
+TEST_F(HazelcastLookupAllocationTest, LookupContextsReused) {
+  insert("/reused", Http::TestHeaderMapImpl{{":status", "200"}}, "Value");
+  LookupContextPtr context = lookup("/reused");
+  const LookupContext* first = context.get();
+  context.reset();
+  // The block of the destroyed context is taken from the free list.
+  context = lookup("/reused");
+  EXPECT_EQ(first, context.get());
+}
+
+TEST_F(HazelcastLookupAllocationTest, AllocationsPerPartition) {
+  if (!AllocationCounter::supported()) {
+    GTEST_SKIP() << "allocations are counted with tcmalloc only";
+  }
+  const std::string body(4 * PARTITION_SIZE, 'b');
+  insert("/partitions", Http::TestHeaderMapImpl{
+      {"date", formatter_.fromTime(current_time_)},
+      {"cache-control", "public, max-age=3600"}}, body);
+
+  // Warm up thread locals and free lists.
+  EXPECT_TRUE(expectLookupSuccessWithBody(lookup("/partitions").get(), body));
+
+  LookupContextPtr context = lookup("/partitions");
+  ASSERT_EQ(CacheEntryStatus::Ok, lookup_result_.cache_entry_status_);
+  const std::vector<uint64_t> allocations =
+      partitionAllocations(*context, body.size());
+  ASSERT_EQ(4, allocations.size());
+  for (const uint64_t& partition_allocations : allocations) {
+    // Independent of the partition index, i.e. of the key length.
+    EXPECT_EQ(allocations[0], partition_allocations);
+    EXPECT_LE(partition_allocations, MAX_PARTITION_ALLOCATIONS);
+  }
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
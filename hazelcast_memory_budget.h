@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Process wide budget of the memory held by inserts in flight.
+ *
+ * Insert contexts reserve the body bytes they stage before buffering
+ * them, a pooled buffer at its capacity, and release them once the
+ * partition is written. In write-behind mode the reservation passes to
+ * the queue with the response, and is released once it is written or
+ * dropped. A reservation exceeding the budget fails, and the insert is
+ * not stored. Hence the staged and queued bytes of all workers stay
+ * below the budget, however many responses are filled at once.
+ *
+ * Accounting is a single atomic counter, without locking.
+ */
+class HazelcastMemoryBudget {
+public:
+  // Unlimited if max_bytes is zero.
+  explicit HazelcastMemoryBudget(uint64_t max_bytes) :
+      max_bytes_(max_bytes) {}
+
+  bool enabled() const { return max_bytes_ > 0; }
+
+  // Reserves the bytes unless the budget would be exceeded. Always
+  // succeeds if the budget is unlimited.
+  bool tryReserve(uint64_t bytes) {
+    if (!enabled()) {
+      return true;
+    }
+    uint64_t used = used_.load(std::memory_order_relaxed);
+    do {
+      if (used + bytes > max_bytes_) {
+        return false;
+      }
+    } while (!used_.compare_exchange_weak(used, used + bytes,
+        std::memory_order_relaxed));
+    return true;
+  }
+
+  // Returns bytes reserved by tryReserve.
+  void release(uint64_t bytes) {
+    if (enabled()) {
+      used_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t used() const { return used_.load(std::memory_order_relaxed); }
+  uint64_t limit() const { return max_bytes_; }
+
+private:
+  const uint64_t max_bytes_;
+  std::atomic<uint64_t> used_{0};
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
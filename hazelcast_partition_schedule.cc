@@ -0,0 +1,92 @@
+#include "hazelcast_partition_schedule.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+// base^exponent by squaring. Only called for partitions smaller than
+// max_size, hence without overflow.
+uint64_t power(uint64_t base, uint64_t exponent) {
+  uint64_t result = 1;
+  while (exponent > 0) {
+    if (exponent & 1) {
+      result *= base;
+    }
+    exponent >>= 1;
+    if (exponent > 0) {
+      base *= base;
+    }
+  }
+  return result;
+}
+
+}
+
+HazelcastPartitionSchedule::HazelcastPartitionSchedule() :
+  HazelcastPartitionSchedule(DEFAULT_PARTITION_SIZE, 1,
+      DEFAULT_PARTITION_SIZE) {};
+
+HazelcastPartitionSchedule::HazelcastPartitionSchedule(uint64_t first_size,
+    uint32_t growth_factor, uint64_t max_size) :
+  first_size_(std::max<uint64_t>(first_size, 1)),
+  growth_factor_(std::max<uint32_t>(growth_factor, 1)),
+  max_size_(growth_factor_ == 1 ? first_size_ :
+      std::max<uint64_t>(max_size, first_size_)),
+  growing_(0), growth_end_(0) {
+  uint64_t size = first_size_;
+  while (size < max_size_) {
+    growing_++;
+    growth_end_ += size;
+    size = size > max_size_ / growth_factor_ ? max_size_ :
+        size * growth_factor_;
+  }
+}
+
+bool HazelcastPartitionSchedule::valid(uint64_t first_size,
+    uint32_t growth_factor, uint64_t max_size) {
+  return first_size > 0 && growth_factor >= 1 && max_size >= first_size &&
+      (growth_factor > 1 || max_size == first_size);
+}
+
+uint64_t HazelcastPartitionSchedule::size(uint64_t index) const {
+  return index < growing_ ? first_size_ * power(growth_factor_, index) :
+      max_size_;
+}
+
+uint64_t HazelcastPartitionSchedule::begin(uint64_t index) const {
+  if (index > growing_) {
+    return growth_end_ + (index - growing_) * max_size_;
+  }
+  // first * (r^k - 1) / (r - 1), where the division is exact. Growing
+  // partitions exist only if r > 1.
+  return index == 0 ? 0 : first_size_ *
+      ((power(growth_factor_, index) - 1) / (growth_factor_ - 1));
+}
+
+uint64_t HazelcastPartitionSchedule::indexOf(uint64_t offset) const {
+  if (offset >= growth_end_) {
+    return growing_ + (offset - growth_end_) / max_size_;
+  }
+  // Inverse of begin(k) for the growing partitions. The estimate may be
+  // off by one due to floating point rounding.
+  const double r = growth_factor_;
+  uint64_t index = std::min<uint64_t>(growing_ - 1, static_cast<uint64_t>(
+      std::log(offset * (r - 1) / first_size_ + 1) / std::log(r)));
+  if (begin(index) > offset) {
+    index--;
+  } else if (begin(index + 1) <= offset) {
+    index++;
+  }
+  return index;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
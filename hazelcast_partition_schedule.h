@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Sizes of the body partitions of a response.
+ *
+ * The first partition has first_size bytes and each following one is
+ * growth_factor times larger than the previous, up to max_size. All
+ * partitions after reaching max_size have max_size bytes:
+ *
+ *   first, first * r, first * r^2, ..., max, max, max, ...
+ *
+ * Hence the first bytes of a response are available after a small
+ * lookup, while large bodies are stored in a few large entries. A
+ * fixed partition size is the special case of first_size == max_size.
+ *
+ * Offsets of the growing partitions follow from the geometric series,
+ * so the schedule is a few integers. Copies into the lookup contexts
+ * and header entries do not allocate, and the partition of a body
+ * offset is found with a few multiplications.
+ */
+class HazelcastPartitionSchedule {
+public:
+  // Fixed partitions of DEFAULT_PARTITION_SIZE bytes.
+  HazelcastPartitionSchedule();
+
+  // Out of range arguments are clamped. Configurations are checked
+  // with valid() first, so that they are rejected instead.
+  HazelcastPartitionSchedule(uint64_t first_size, uint32_t growth_factor,
+      uint64_t max_size);
+
+  // True if first_size is positive, growth_factor is at least 1 and
+  // max_size is not below first_size. A growth_factor of 1 requires
+  // max_size == first_size.
+  static bool valid(uint64_t first_size, uint32_t growth_factor,
+      uint64_t max_size);
+
+  static HazelcastPartitionSchedule fixed(uint64_t partition_size) {
+    return HazelcastPartitionSchedule(partition_size, 1, partition_size);
+  }
+
+  // Size of the partition at the given index.
+  uint64_t size(uint64_t index) const;
+
+  // Body offset of the first byte of the partition at the given index.
+  uint64_t begin(uint64_t index) const;
+
+  // Index of the partition containing the given body offset.
+  uint64_t indexOf(uint64_t offset) const;
+
+  // Number of partitions of a body with the given size.
+  uint64_t count(uint64_t body_size) const {
+    return body_size == 0 ? 0 : indexOf(body_size - 1) + 1;
+  }
+
+  uint64_t firstSize() const { return first_size_; }
+  uint32_t growthFactor() const { return growth_factor_; }
+  uint64_t maxSize() const { return max_size_; }
+
+  static const uint64_t DEFAULT_PARTITION_SIZE = 1024;
+
+private:
+  uint64_t first_size_;
+  uint32_t growth_factor_;
+  uint64_t max_size_;
+
+  // Number of partitions smaller than max_size, and the offset where
+  // the partitions of max_size start.
+  uint64_t growing_;
+  uint64_t growth_end_;
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,51 @@
+#include "hazelcast_partition_schedule.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+TEST(HazelcastPartitionScheduleTest, IndexOf) {
+  for (const HazelcastPartitionSchedule& schedule : {
+      HazelcastPartitionSchedule(1, 2, 64),
+      HazelcastPartitionSchedule(3, 3, 1000),
+      HazelcastPartitionSchedule(100, 2, 150),
+      HazelcastPartitionSchedule::fixed(10)}) {
+    uint64_t index = 0;
+    for (uint64_t offset = 0; offset < 20 * schedule.maxSize(); offset++) {
+      while (schedule.begin(index + 1) <= offset) {
+        index++;
+      }
+      EXPECT_EQ(schedule.size(index),
+          schedule.begin(index + 1) - schedule.begin(index));
+      ASSERT_EQ(index, schedule.indexOf(offset)) << offset;
+    }
+  }
+  const HazelcastPartitionSchedule schedule(4, 2, 16);
+  EXPECT_EQ(0, schedule.count(0));
+  EXPECT_EQ(1, schedule.count(4));
+  EXPECT_EQ(5, schedule.count(50));
+  EXPECT_EQ(16, schedule.size(7));
+}
+
+
+TEST(HazelcastPartitionScheduleTest, Valid) {
+  EXPECT_TRUE(HazelcastPartitionSchedule::valid(4, 2, 16));
+  EXPECT_TRUE(HazelcastPartitionSchedule::valid(10, 1, 10));
+  EXPECT_TRUE(HazelcastPartitionSchedule::valid(10, 3, 10));
+  EXPECT_FALSE(HazelcastPartitionSchedule::valid(0, 2, 16));
+  EXPECT_FALSE(HazelcastPartitionSchedule::valid(4, 0, 16));
+  // max_size not set.
+  EXPECT_FALSE(HazelcastPartitionSchedule::valid(4, 2, 0));
+  // Would never grow.
+  EXPECT_FALSE(HazelcastPartitionSchedule::valid(4, 1, 16));
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
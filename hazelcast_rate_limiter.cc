@@ -0,0 +1,91 @@
+#include "hazelcast_rate_limiter.h"
+
+#include <algorithm>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+HazelcastRateLimiter::HazelcastRateLimiter(
+    const InsertRateLimitConfig& config)
+  : bytes_per_second_(config.bytes_per_second()),
+  burst_bytes_(config.burst_bytes() > 0 ? config.burst_bytes() :
+      config.bytes_per_second()),
+  shared_(!config.shared_map_name().empty()),
+  lease_bytes_(std::max<uint64_t>(config.lease_bytes() > 0 ?
+      config.lease_bytes() : config.bytes_per_second() / 16, 1)),
+  // Starts full, so the first inserts are not delayed.
+  tokens_(burst_bytes_), last_refill_(Clock::now()) {}
+
+bool HazelcastRateLimiter::allow(uint64_t bytes, StorageBackend& backend,
+    std::chrono::system_clock::time_point now) {
+  if (!enabled() || bytes == 0) {
+    return true;
+  }
+  if (!shared_) {
+    return tryConsume(bytes);
+  }
+  const int64_t window = std::chrono::duration_cast<std::chrono::seconds>(
+      now.time_since_epoch()).count();
+  {
+    absl::MutexLock lock(&mutex_);
+    if (lease_window_ != window) {
+      lease_window_ = window;
+      leased_ = 0;
+    }
+    if (leased_ >= bytes) {
+      leased_ -= bytes;
+      return true;
+    }
+  }
+  // Not locked meanwhile, workers leasing at once lease a chunk each.
+  const uint64_t lease = std::max(lease_bytes_, bytes);
+  uint64_t total = 0;
+  backend.addInsertedBytes(window, lease,
+      [&total](uint64_t sum) { total = sum; });
+  if (total == 0) {
+    // The sum could not be updated.
+    return tryConsume(bytes);
+  }
+  // Granted up to the limit. A partition larger than the limit passes
+  // alone in a second.
+  const uint64_t before = total - lease;
+  const uint64_t limit = std::max(bytes_per_second_, bytes);
+  const uint64_t granted = before < limit ? std::min(lease, limit - before) : 0;
+  absl::MutexLock lock(&mutex_);
+  if (lease_window_ != window) {
+    // The second ended while leasing, its lease is lost.
+    return granted >= bytes;
+  }
+  leased_ += granted;
+  if (leased_ < bytes) {
+    return false;
+  }
+  leased_ -= bytes;
+  return true;
+}
+
+bool HazelcastRateLimiter::tryConsume(uint64_t bytes, Clock::time_point now) {
+  if (!enabled()) {
+    return true;
+  }
+  absl::MutexLock lock(&mutex_);
+  if (now > last_refill_) {
+    const double elapsed_s =
+        std::chrono::duration<double>(now - last_refill_).count();
+    tokens_ = std::min(burst_bytes_, tokens_ + elapsed_s * bytes_per_second_);
+    last_refill_ = now;
+  }
+  // Larger partitions than the burst pass on a full bucket.
+  if (tokens_ < std::min<double>(bytes, burst_bytes_)) {
+    return false;
+  }
+  tokens_ -= bytes;
+  return true;
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+
+#include "absl/synchronization/mutex.h"
+#include "hazelcast_storage_backend.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Limit of the body bytes written to the cluster per second.
+ *
+ * Each partition takes its stored size, i.e. compressed, from a token
+ * bucket before it is written, and so does its identity copy. In
+ * write-behind mode the queue takes the stored size of each response
+ * before writing it instead (see HazelcastWriteBehindQueue). The
+ * bucket holds up to burst_bytes and refills with bytes_per_second. A
+ * partition larger than the burst passes when the bucket is full,
+ * leaving it in debt. An insert whose bytes do not pass is not stored
+ * (see HazelcastInsertSkip). Hence after a purge or a cold start, when
+ * every miss becomes an insert, the write load of the cluster stays
+ * bounded and lookups keep their latency.
+ *
+ * If shared_map_name is set, the bytes of all Envoys are summed on the
+ * cluster per second instead (see StorageBackend::addInsertedBytes).
+ * Each Envoy leases lease_bytes of the second at once and takes
+ * partitions from its lease, hence a round trip per lease instead of
+ * per partition. A lease is granted as far as the sum stays within
+ * bytes_per_second; bytes leased but not written when the second ends
+ * are lost. The local bucket is used when the sum cannot be updated.
+ */
+class HazelcastRateLimiter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  HazelcastRateLimiter(const InsertRateLimitConfig& config);
+
+  // False if inserts are not limited.
+  bool enabled() const { return bytes_per_second_ > 0; }
+  bool shared() const { return shared_; }
+  uint64_t bytesPerSecond() const { return bytes_per_second_; }
+
+  // True if the bytes may be written: taken from the lease of the
+  // current second in shared mode, leasing more from the backend if
+  // needed, and from the local bucket otherwise.
+  bool allow(uint64_t bytes, StorageBackend& backend,
+      std::chrono::system_clock::time_point now =
+          std::chrono::system_clock::now());
+
+  // Takes the bytes from the local bucket if available.
+  bool tryConsume(uint64_t bytes, Clock::time_point now = Clock::now());
+
+private:
+  const uint64_t bytes_per_second_;
+  const double burst_bytes_;
+  const bool shared_;
+  const uint64_t lease_bytes_;
+
+  absl::Mutex mutex_;
+  double tokens_ GUARDED_BY(mutex_);
+  Clock::time_point last_refill_ GUARDED_BY(mutex_);
+  // Second of the lease (seconds since epoch) and its bytes left.
+  int64_t lease_window_ GUARDED_BY(mutex_) = 0;
+  uint64_t leased_ GUARDED_BY(mutex_) = 0;
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
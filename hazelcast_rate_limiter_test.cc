@@ -0,0 +1,71 @@
+#include "hazelcast_local_backend.h"
+#include "hazelcast_rate_limiter.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+TEST(HazelcastRateLimiterTest, TokenBucket) {
+  InsertRateLimitConfig config;
+  config.set_bytes_per_second(100);
+  config.set_burst_bytes(200);
+  HazelcastRateLimiter limiter(config);
+  ASSERT_TRUE(limiter.enabled());
+  EXPECT_FALSE(limiter.shared());
+
+  HazelcastRateLimiter::Clock::time_point now =
+      HazelcastRateLimiter::Clock::now();
+  EXPECT_TRUE(limiter.tryConsume(150, now));
+  EXPECT_TRUE(limiter.tryConsume(50, now));
+  EXPECT_FALSE(limiter.tryConsume(1, now));
+  // Refilled with bytes_per_second, up to the burst.
+  now += std::chrono::milliseconds(500);
+  EXPECT_FALSE(limiter.tryConsume(60, now));
+  EXPECT_TRUE(limiter.tryConsume(50, now));
+  now += std::chrono::seconds(10);
+  // Larger than the burst, passes on a full bucket only.
+  EXPECT_TRUE(limiter.tryConsume(300, now));
+  EXPECT_FALSE(limiter.tryConsume(1, now));
+  now += std::chrono::seconds(2);
+  EXPECT_TRUE(limiter.tryConsume(100, now));
+  EXPECT_FALSE(HazelcastRateLimiter(InsertRateLimitConfig()).enabled());
+}
+
+TEST(HazelcastRateLimiterTest, SharedLeases) {
+  InsertRateLimitConfig config;
+  config.set_bytes_per_second(100);
+  config.set_shared_map_name("insert_rate");
+  config.set_lease_bytes(40);
+  HazelcastRateLimiter limiter(config);
+  ASSERT_TRUE(limiter.shared());
+  LocalStorageBackend backend;
+  const std::chrono::system_clock::time_point now(std::chrono::seconds(1000));
+  auto sum = [&backend]() {
+    uint64_t total = 0;
+    backend.addInsertedBytes(1000, 0, [&total](uint64_t bytes) { total = bytes; });
+    return total;
+  };
+
+  EXPECT_TRUE(limiter.allow(10, backend, now));
+  EXPECT_EQ(40, sum());
+  // Taken from the lease, without a round trip.
+  EXPECT_TRUE(limiter.allow(30, backend, now));
+  EXPECT_EQ(40, sum());
+  // Other Envoys wrote 50 bytes meanwhile, hence 10 are granted.
+  backend.addInsertedBytes(1000, 50, [](uint64_t) {});
+  EXPECT_FALSE(limiter.allow(20, backend, now));
+  EXPECT_TRUE(limiter.allow(10, backend, now));
+  EXPECT_FALSE(limiter.allow(1, backend, now));
+  // A new second starts a new lease.
+  EXPECT_TRUE(limiter.allow(20, backend, now + std::chrono::seconds(1)));
+}
+
+} // namespace
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,249 @@
+#include "hazelcast_remote_backend.h"
+
+#include "hazelcast/client/exception/IException.h"
+#include "hazelcast/client/spi/ClientContext.h"
+#include "hazelcast/client/spi/ClientPartitionService.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+namespace {
+
+using hazelcast::client::exception::IException;
+
+const uint32_t DEFAULT_ADMISSION_WINDOW_S = 3600;
+
+// Compare and set attempts of a count before giving up.
+const int MAX_INCREMENT_ATTEMPTS = 4;
+
+const int64_t INSERT_RATE_WINDOW_TTL_MS = 10 * 1000;
+
+// Adds delta to the counter of the key. The first addition creates
+// the counter with the given TTL, the following ones replace it unless
+// another Envoy did meanwhile. Returns the new value, or zero if the
+// counter is contended.
+int64_t addToCounter(IMap<int64_t, int64_t> map, int64_t key, int64_t delta,
+    int64_t ttl_ms) {
+  for (int attempt = 0; attempt < MAX_INCREMENT_ATTEMPTS; attempt++) {
+    boost::shared_ptr<int64_t> value = map.putIfAbsent(key, delta, ttl_ms);
+    if (!value) {
+      return delta;
+    }
+    if (map.replace(key, *value, *value + delta)) {
+      return *value + delta;
+    }
+  }
+  return 0;
+}
+
+// Resolves the member owning the partition of the given key. Empty if
+// it cannot be resolved, e.g. while the client reconnects.
+template <typename K>
+std::string ownerAddress(HazelcastClient& hz, const K& key) {
+  try {
+    hazelcast::client::spi::ClientContext context(hz);
+    hazelcast::client::spi::ClientPartitionService& partition_service =
+        context.getPartitionService();
+    hazelcast::client::serialization::pimpl::Data key_data =
+        context.getSerializationService().toData<K>(&key);
+    boost::shared_ptr<hazelcast::client::Address> owner =
+        partition_service.getPartitionOwner(
+            partition_service.getPartitionId(key_data));
+    return owner ? owner->toString() : "";
+  } catch (IException&) {
+    return "";
+  }
+}
+
+}
+
+RemoteStorageBackend::RemoteStorageBackend(const HazelcastConfig& config) :
+  header_map_name_(config.header_map_name()),
+  body_map_name_(config.body_map_name()),
+  admission_map_name_(config.admission().shared_map_name()),
+  admission_window_ms_(1000 * static_cast<int64_t>(
+      config.admission().shared_window_s() > 0 ?
+      config.admission().shared_window_s() : DEFAULT_ADMISSION_WINDOW_S)),
+  insert_rate_map_name_(config.insert_rate_limit().shared_map_name()) {
+  hazelcast::client::ClientConfig client_config;
+  client_config.getGroupConfig().setName(config.group_name());
+  client_config.getGroupConfig().setPassword(config.group_password());
+
+  client_config.getNetworkConfig().addAddress(
+      hazelcast::client::Address(config.ip(), config.port()));
+
+  client_config.getSerializationConfig().addDataSerializableFactory(
+      HazelcastCacheEntrySerializableFactory::FACTORY_ID,
+      boost::shared_ptr<hazelcast::client::serialization::DataSerializableFactory>
+          (new HazelcastCacheEntrySerializableFactory()));
+
+  hz = std::make_unique<HazelcastClient>(client_config);
+}
+
+RemoteStorageBackend::~RemoteStorageBackend() {
+  hz->shutdown();
+}
+
+void RemoteStorageBackend::getHeader(const uint64_t& hash_key,
+    HeaderLookupCallback&& cb) {
+  HazelcastHeaderPtr entry;
+  try {
+    entry = headerMap().get(static_cast<int64_t>(hash_key));
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast header lookup failed: {}", e.what());
+  }
+  cb(std::move(entry));
+}
+
+void RemoteStorageBackend::getBody(absl::string_view key,
+    BodyLookupCallback&& cb) {
+  HazelcastBodyPtr entry;
+  try {
+    // The client map takes keys as std::string, hence copied.
+    entry = bodyMap().get(std::string(key));
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast body lookup failed: {}", e.what());
+  }
+  cb(std::move(entry));
+}
+
+void RemoteStorageBackend::putHeader(const uint64_t& hash_key,
+    const HazelcastHeaderEntry& entry, StorageCallback&& cb) {
+  try {
+    headerMap().set(static_cast<int64_t>(hash_key), entry);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast header insert failed: {}", e.what());
+    cb(false);
+    return;
+  }
+  cb(true);
+}
+
+void RemoteStorageBackend::putBody(const std::string& key,
+    const HazelcastBodyEntry& entry, StorageCallback&& cb) {
+  try {
+    bodyMap().set(key, entry);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast body insert failed: {}", e.what());
+    cb(false);
+    return;
+  }
+  cb(true);
+}
+
+void RemoteStorageBackend::removeBody(const std::string& key,
+    StorageCallback&& cb) {
+  try {
+    bodyMap().deleteEntry(key);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast body remove failed: {}", e.what());
+    cb(false);
+    return;
+  }
+  cb(true);
+}
+
+void RemoteStorageBackend::putHeaders(
+    const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+    StorageCallback&& cb) {
+  // Keys are signed on the map. Copies share the header bytes.
+  std::map<int64_t, HazelcastHeaderEntry> signed_entries;
+  for (const auto& entry : entries) {
+    signed_entries.emplace(static_cast<int64_t>(entry.first), entry.second);
+  }
+  try {
+    headerMap().putAll(signed_entries);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast header batch insert failed: {}", e.what());
+    cb(false);
+    return;
+  }
+  cb(true);
+}
+
+void RemoteStorageBackend::putBodies(
+    const std::map<std::string, HazelcastBodyEntry>& entries,
+    StorageCallback&& cb) {
+  try {
+    bodyMap().putAll(entries);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast body batch insert failed: {}", e.what());
+    cb(false);
+    return;
+  }
+  cb(true);
+}
+
+void RemoteStorageBackend::addRequestCount(const uint64_t& hash_key,
+    uint64_t misses, CountCallback&& cb) {
+  int64_t count = 0;
+  try {
+    count = addToCounter(admissionMap(), static_cast<int64_t>(hash_key),
+        misses, admission_window_ms_);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast request count failed: {}", e.what());
+  }
+  cb(count);
+}
+
+void RemoteStorageBackend::addInsertedBytes(int64_t window, uint64_t bytes,
+    CountCallback&& cb) {
+  int64_t total = 0;
+  try {
+    // Windows are short, expired soon after they pass.
+    total = addToCounter(insertRateMap(), window, bytes,
+        INSERT_RATE_WINDOW_TTL_MS);
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast inserted bytes count failed: {}", e.what());
+  }
+  cb(total);
+}
+
+void RemoteStorageBackend::clear() {
+  bodyMap().clear();
+  headerMap().clear();
+}
+
+bool RemoteStorageBackend::isConnected() {
+  return hz->getLifecycleService().isRunning();
+}
+
+std::vector<std::string> RemoteStorageBackend::memberAddresses() {
+  std::vector<std::string> addresses;
+  if (!isConnected()) return addresses;
+  try {
+    for (const hazelcast::client::Member& member :
+        hz->getCluster().getMembers()) {
+      addresses.push_back(member.getAddress().toString());
+    }
+  } catch (IException& e) {
+    ENVOY_LOG(warn, "Hazelcast member listing failed: {}", e.what());
+  }
+  return addresses;
+}
+
+std::string RemoteStorageBackend::headerOwnerAddress(const uint64_t& hash_key) {
+  return ownerAddress<int64_t>(*hz, static_cast<int64_t>(hash_key));
+}
+
+std::string RemoteStorageBackend::bodyOwnerAddress(const std::string& key) {
+  return ownerAddress<std::string>(*hz, key);
+}
+
+int64_t RemoteStorageBackend::headerExpirationTime(const uint64_t& hash_key) {
+  IMap<int64_t, HazelcastHeaderEntry> header_map = headerMap();
+  int64_t key = static_cast<int64_t>(hash_key);
+  try {
+    // getEntryView does not handle missing entries.
+    if (!header_map.containsKey(key)) return -1;
+    return header_map.getEntryView(key).expirationTime;
+  } catch (IException&) {
+    return -1;
+  }
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
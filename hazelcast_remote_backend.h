@@ -0,0 +1,85 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "hazelcast/client/HazelcastClient.h"
+#include "hazelcast/client/IMap.h"
+#include "hazelcast_storage_backend.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+using hazelcast::client::HazelcastClient;
+using hazelcast::client::IMap;
+
+/**
+ * Storage backend on a Hazelcast cluster.
+ *
+ * Headers and bodies are stored on two distributed maps whose names
+ * are configured by header_map_name and body_map_name. The client
+ * connects to the cluster on construction and shuts down on
+ * destruction.
+ *
+ * Operations are completed before the calls return, as StorageBackend
+ * requires, hence each round trip blocks the calling worker.
+ */
+class RemoteStorageBackend : public StorageBackend,
+    Logger::Loggable<Logger::Id::http> {
+public:
+  RemoteStorageBackend(const HazelcastConfig& config);
+  ~RemoteStorageBackend();
+
+  // StorageBackend
+  void getHeader(const uint64_t& hash_key, HeaderLookupCallback&& cb) override;
+  void getBody(absl::string_view key, BodyLookupCallback&& cb) override;
+  void putHeader(const uint64_t& hash_key, const HazelcastHeaderEntry& entry,
+      StorageCallback&& cb) override;
+  void putBody(const std::string& key, const HazelcastBodyEntry& entry,
+      StorageCallback&& cb) override;
+  void removeBody(const std::string& key, StorageCallback&& cb) override;
+  void putHeaders(const std::map<uint64_t, HazelcastHeaderEntry>& entries,
+      StorageCallback&& cb) override;
+  void putBodies(const std::map<std::string, HazelcastBodyEntry>& entries,
+      StorageCallback&& cb) override;
+  void addRequestCount(const uint64_t& hash_key, uint64_t misses,
+      CountCallback&& cb) override;
+  void addInsertedBytes(int64_t window, uint64_t bytes,
+      CountCallback&& cb) override;
+  void clear() override;
+  bool isConnected() override;
+  std::vector<std::string> memberAddresses() override;
+  std::string headerOwnerAddress(const uint64_t& hash_key) override;
+  std::string bodyOwnerAddress(const std::string& key) override;
+  int64_t headerExpirationTime(const uint64_t& hash_key) override;
+
+private:
+  inline IMap<int64_t, HazelcastHeaderEntry> headerMap() {
+    return hz->getMap<int64_t, HazelcastHeaderEntry>(header_map_name_);
+  }
+
+  inline IMap<std::string, HazelcastBodyEntry> bodyMap() {
+    return hz->getMap<std::string, HazelcastBodyEntry>(body_map_name_);
+  }
+
+  inline IMap<int64_t, int64_t> admissionMap() {
+    return hz->getMap<int64_t, int64_t>(admission_map_name_);
+  }
+
+  inline IMap<int64_t, int64_t> insertRateMap() {
+    return hz->getMap<int64_t, int64_t>(insert_rate_map_name_);
+  }
+
+  const std::string header_map_name_;
+  const std::string body_map_name_;
+  const std::string admission_map_name_;
+  const int64_t admission_window_ms_;
+  const std::string insert_rate_map_name_;
+  std::unique_ptr<HazelcastClient> hz;
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <map>
+
+#include "envoy/common/pure.h"
+#include "absl/strings/string_view.h"
+
+#include "hazelcast_cache_entry.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+// A null entry means either a miss or a failed lookup.
+using HeaderLookupCallback = std::function<void(HazelcastHeaderPtr&&)>;
+using BodyLookupCallback = std::function<void(HazelcastBodyPtr&&)>;
+using StorageCallback = std::function<void(bool success)>;
+// Zero if the count is not available.
+using CountCallback = std::function<void(uint64_t count)>;
+
+/**
+ * Key/value storage used by the lookup and insert contexts.
+ *
+ * Header entries are keyed by the 64 bit hash of the cache key and
+ * body entries by the partition key (see hazelcast_cache_entry.h).
+ * Keys passed as string views are only used until the call returns.
+ *
+ * Operations are synchronous: the result is passed to the callback,
+ * which is invoked on the calling thread before the call returns.
+ * Lookup and insert contexts rely on this, as their callbacks capture
+ * the context and the context may be destroyed once the call returns.
+ * A backend completing operations later would need the contexts to
+ * cancel their callbacks on destruction first. Implementations must be
+ * thread safe since one backend is shared by all workers, and must not
+ * throw; failures are reported via the callbacks.
+ */
+class StorageBackend {
+public:
+  virtual ~StorageBackend() = default;
+
+  virtual void getHeader(const uint64_t& hash_key,
+      HeaderLookupCallback&& cb) PURE;
+  virtual void getBody(absl::string_view key, BodyLookupCallback&& cb) PURE;
+  virtual void putHeader(const uint64_t& hash_key,
+      const HazelcastHeaderEntry& entry, StorageCallback&& cb) PURE;
+  virtual void putBody(const std::string& key,
+      const HazelcastBodyEntry& entry, StorageCallback&& cb) PURE;
+
+  // Removes a body entry, e.g. a partition of an aborted insert.
+  virtual void removeBody(const std::string& key, StorageCallback&& cb) PURE;
+
+  // Writes the entries in a single round trip where possible (putAll).
+  // The callback reports whether all of them are stored.
+  virtual void putHeaders(const std::map<uint64_t, HazelcastHeaderEntry>&
+      entries, StorageCallback&& cb) PURE;
+  virtual void putBodies(const std::map<std::string, HazelcastBodyEntry>&
+      entries, StorageCallback&& cb) PURE;
+
+  // Adds misses of the key to the count on the admission map (see
+  // HazelcastAdmissionFilter) and passes the new count. A count
+  // expires after the admission window, from its first miss.
+  virtual void addRequestCount(const uint64_t& hash_key, uint64_t misses,
+      CountCallback&& cb) PURE;
+
+  // Adds bytes inserted during the given window (seconds since epoch)
+  // to the count of all Envoys (see HazelcastRateLimiter) and passes
+  // the new total.
+  virtual void addInsertedBytes(int64_t window, uint64_t bytes,
+      CountCallback&& cb) PURE;
+
+  // Removes all entries. Intended for tests.
+  virtual void clear() PURE;
+
+  // Introspection helpers, used for tracing and admin output.
+  virtual bool isConnected() PURE;
+  virtual std::vector<std::string> memberAddresses() PURE;
+  virtual std::string headerOwnerAddress(const uint64_t& hash_key) PURE;
+  virtual std::string bodyOwnerAddress(const std::string& key) PURE;
+  // Expiration time of the header entry in milliseconds since epoch,
+  // INT64_MAX if the entry never expires or a negative value if the
+  // entry does not exist.
+  virtual int64_t headerExpirationTime(const uint64_t& hash_key) PURE;
+};
+
+using StorageBackendPtr = std::unique_ptr<StorageBackend>;
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * Instances of T sharded by thread.
+ *
+ * Each thread using the shards gets its own T on first use, found
+ * again through a thread local list without locking. Hence each
+ * worker has a shard of its own, whatever the number of workers, and
+ * workers do not contend on their shards. Other threads (e.g. the main
+ * thread or a background thread) get shards as well.
+ *
+ * Shards are destroyed with the instance. The thread local lists keep
+ * an id and a pointer per instance used by the thread, and ids are not
+ * reused, so a later instance never finds a shard of a destroyed one.
+ */
+template <typename T>
+class HazelcastThreadShards {
+public:
+  HazelcastThreadShards() : id_(nextId()) {}
+
+  // Shard of the calling thread, created on first use.
+  T& local() {
+    std::vector<std::pair<uint64_t, T*>>& shards = threadShards();
+    for (const std::pair<uint64_t, T*>& shard : shards) {
+      if (shard.first == id_) {
+        return *shard.second;
+      }
+    }
+    auto shard = std::make_unique<T>();
+    T* created = shard.get();
+    {
+      absl::MutexLock lock(&mutex_);
+      shards_.push_back(std::move(shard));
+    }
+    shards.emplace_back(id_, created);
+    return *created;
+  }
+
+  // Calls visit with each shard. Shards created meanwhile may be
+  // missed.
+  template <typename Visit>
+  void forEach(Visit visit) {
+    absl::MutexLock lock(&mutex_);
+    for (std::unique_ptr<T>& shard : shards_) {
+      visit(*shard);
+    }
+  }
+
+private:
+  static std::vector<std::pair<uint64_t, T*>>& threadShards() {
+    thread_local std::vector<std::pair<uint64_t, T*>> shards;
+    return shards;
+  }
+
+  static uint64_t nextId() {
+    static std::atomic<uint64_t> next_id{0};
+    return next_id++;
+  }
+
+  const uint64_t id_;
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<T>> shards_ GUARDED_BY(mutex_);
+};
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
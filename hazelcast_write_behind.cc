@@ -0,0 +1,243 @@
+#include "hazelcast_write_behind.h"
+
+#include <algorithm>
+#include <map>
+
+#include "absl/time/time.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+namespace {
+
+// Entries of a single putAll, and the responses having entries in it.
+template <typename K, typename V>
+struct Batch {
+  std::map<K, V> entries;
+  uint64_t bytes = 0;
+  std::vector<size_t> inserts;
+};
+
+}
+
+HazelcastWriteBehindQueue::HazelcastWriteBehindQueue(
+    const WriteBehindConfig& config, StorageBackend& backend,
+    HazelcastMemoryBudget& memory_budget, HazelcastRateLimiter& rate_limiter,
+    HazelcastOperationStats& operation_stats)
+  : max_queued_bytes_(config.max_queued_bytes()),
+  max_batch_bytes_(config.max_batch_bytes() > 0 ? config.max_batch_bytes() :
+      DEFAULT_MAX_BATCH_BYTES),
+  max_delay_(config.max_delay_ms() > 0 ? config.max_delay_ms() :
+      DEFAULT_MAX_DELAY_MS),
+  backend_(backend), memory_budget_(memory_budget),
+  rate_limiter_(rate_limiter), operation_stats_(operation_stats) {
+  flusher_ = std::thread([this]() { run(); });
+}
+
+HazelcastWriteBehindQueue::~HazelcastWriteBehindQueue() {
+  {
+    absl::MutexLock lock(&flusher_mutex_);
+    stopping_ = true;
+    wake_ = true;
+  }
+  // The background thread writes the remaining responses on exit.
+  flusher_.join();
+}
+
+bool HazelcastWriteBehindQueue::push(HazelcastPendingInsertPtr&& insert) {
+  const uint64_t bytes = insert->bytes;
+  WorkerQueue& worker = workers_.local();
+  {
+    absl::MutexLock lock(&worker.mutex);
+    if (worker.bytes + bytes > max_queued_bytes_) {
+      dropped_++;
+      memory_budget_.release(insert->reserved_bytes);
+      return false;
+    }
+    worker.bytes += bytes;
+    worker.inserts.push_back(std::move(insert));
+  }
+  queued_inserts_++;
+  if (queued_bytes_.fetch_add(bytes) + bytes >= max_batch_bytes_) {
+    absl::MutexLock lock(&flusher_mutex_);
+    wake_ = true;
+  }
+  return true;
+}
+
+void HazelcastWriteBehindQueue::flush() {
+  write(takeAll());
+}
+
+void HazelcastWriteBehindQueue::run() {
+  bool stopping = false;
+  while (!stopping) {
+    {
+      absl::MutexLock lock(&flusher_mutex_);
+      flusher_mutex_.AwaitWithTimeout(absl::Condition(&wake_),
+          absl::FromChrono(max_delay_));
+      stopping = stopping_;
+      wake_ = false;
+    }
+    write(takeAll());
+  }
+}
+
+std::vector<HazelcastPendingInsertPtr> HazelcastWriteBehindQueue::takeAll() {
+  std::vector<HazelcastPendingInsertPtr> inserts;
+  workers_.forEach([this, &inserts](WorkerQueue& worker) {
+    absl::MutexLock lock(&worker.mutex);
+    queued_inserts_ -= worker.inserts.size();
+    queued_bytes_ -= worker.bytes;
+    worker.bytes = 0;
+    for (HazelcastPendingInsertPtr& insert : worker.inserts) {
+      inserts.push_back(std::move(insert));
+    }
+    worker.inserts.clear();
+  });
+  return inserts;
+}
+
+void HazelcastWriteBehindQueue::write(
+    std::vector<HazelcastPendingInsertPtr>&& inserts) {
+  if (inserts.empty()) {
+    return;
+  }
+  absl::MutexLock write_lock(&write_mutex_);
+
+  // Of several responses for the same key, only the last one is kept,
+  // with its own partitions and headers.
+  std::map<uint64_t, size_t> last_of_key;
+  for (size_t i = 0; i < inserts.size(); i++) {
+    if (!inserts[i]->headers.empty()) {
+      last_of_key[inserts[i]->headers.front().first] = i;
+    }
+  }
+  std::vector<HazelcastPendingInsertPtr> kept;
+  for (size_t i = 0; i < inserts.size(); i++) {
+    if (!inserts[i]->headers.empty() &&
+        last_of_key[inserts[i]->headers.front().first] != i) {
+      superseded_++;
+      memory_budget_.release(inserts[i]->reserved_bytes);
+      continue;
+    }
+    kept.push_back(std::move(inserts[i]));
+  }
+  inserts.swap(kept);
+
+  // Responses over the insert rate limit are not written at all.
+  inserts.erase(std::remove_if(inserts.begin(), inserts.end(),
+      [this](const HazelcastPendingInsertPtr& insert) {
+    if (rate_limiter_.allow(insert->bytes, backend_)) {
+      return false;
+    }
+    rate_limited_++;
+    memory_budget_.release(insert->reserved_bytes);
+    return true;
+  }), inserts.end());
+
+  // Partitions in batches of at most max_batch_bytes. putAll groups the
+  // entries of a batch by partition itself, hence they are not grouped
+  // by owner here. Content keys (deduplicated partitions) shared by
+  // several responses are written once, by the batch having the key
+  // first. Other keys are derived from the header key, which is unique
+  // among the responses kept above.
+  using BodyBatch = Batch<std::string, HazelcastBodyEntry>;
+  std::vector<BodyBatch> body_batches;
+  std::map<std::string, size_t> batch_of_key;
+  for (size_t i = 0; i < inserts.size(); i++) {
+    const bool content_keys = inserts[i]->content_keys;
+    for (auto& partition : inserts[i]->partitions) {
+      if (content_keys) {
+        auto written = batch_of_key.find(partition.first);
+        if (written != batch_of_key.end()) {
+          body_batches[written->second].inserts.push_back(i);
+          continue;
+        }
+      }
+      const uint64_t size = partition.second.size();
+      if (body_batches.empty() || (!body_batches.back().entries.empty() &&
+          body_batches.back().bytes + size > max_batch_bytes_)) {
+        body_batches.emplace_back();
+      }
+      BodyBatch& batch = body_batches.back();
+      batch.bytes += size;
+      batch.inserts.push_back(i);
+      if (content_keys) {
+        batch_of_key.emplace(partition.first, body_batches.size() - 1);
+      }
+      batch.entries.emplace(partition.first, std::move(partition.second));
+    }
+    inserts[i]->partitions.clear();
+  }
+
+  // Failed responses are not committed. The backend completes each
+  // batch before returning (see hazelcast_storage_backend.h).
+  std::vector<bool> failed(inserts.size(), false);
+  for (BodyBatch& batch : body_batches) {
+    batches_++;
+    HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+    backend_.putBodies(batch.entries, [&, start](bool success) {
+      operation_stats_.end(HazelcastOperation::InsertBody, start);
+      if (!success) {
+        for (size_t i : batch.inserts) failed[i] = true;
+      }
+    });
+  }
+  // The partitions are freed once written, hence their memory too.
+  body_batches.clear();
+  for (const HazelcastPendingInsertPtr& insert : inserts) {
+    memory_budget_.release(insert->reserved_bytes);
+  }
+
+  size_t max_headers = 0;
+  for (const HazelcastPendingInsertPtr& insert : inserts) {
+    max_headers = std::max(max_headers, insert->headers.size());
+  }
+  for (size_t position = 0; position < max_headers; position++) {
+    writeHeaders(inserts, failed, position);
+  }
+  for (size_t i = 0; i < inserts.size(); i++) {
+    if (failed[i]) {
+      failed_++;
+    } else {
+      committed_++;
+    }
+  }
+}
+
+void HazelcastWriteBehindQueue::writeHeaders(
+    std::vector<HazelcastPendingInsertPtr>& inserts,
+    std::vector<bool>& failed, size_t position) {
+  // Headers are small, hence a single batch. Response headers have
+  // distinct keys here; the Vary spec shared by variants of the same
+  // request is written by the later one.
+  Batch<uint64_t, HazelcastHeaderEntry> batch;
+  for (size_t i = 0; i < inserts.size(); i++) {
+    if (failed[i] || position >= inserts[i]->headers.size()) {
+      continue;
+    }
+    const auto& header = inserts[i]->headers[position];
+    batch.entries.erase(header.first);
+    batch.entries.emplace(header.first, header.second);
+    batch.inserts.push_back(i);
+  }
+  if (batch.entries.empty()) {
+    return;
+  }
+  batches_++;
+  HazelcastOperationStats::TimePoint start = operation_stats_.begin();
+  backend_.putHeaders(batch.entries, [&, start](bool success) {
+    operation_stats_.end(HazelcastOperation::InsertHeader, start);
+    if (!success) {
+      for (size_t i : batch.inserts) failed[i] = true;
+    }
+  });
+}
+
+} // Cache
+} // HttpFilters
+} // Extensions
+} // Envoy
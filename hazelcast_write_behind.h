@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "hazelcast_cache_stats.h"
+#include "hazelcast_memory_budget.h"
+#include "hazelcast_rate_limiter.h"
+#include "hazelcast_storage_backend.h"
+#include "hazelcast_thread_shards.h"
+#include "hazelcast.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Cache {
+
+/**
+ * A complete response waiting to be written: its body partitions and
+ * the header entries committing them.
+ */
+struct HazelcastPendingInsert {
+  // Partitions of all representations of the body.
+  std::vector<std::pair<std::string, HazelcastBodyEntry>> partitions;
+  // Written in order once all partitions are stored, i.e. the response
+  // header, then the Vary spec if the response varies.
+  std::vector<std::pair<uint64_t, HazelcastHeaderEntry>> headers;
+  // Partition keys are digests of their content (deduplicated bodies),
+  // hence may be shared with other responses.
+  bool content_keys = false;
+  // Stored bytes of the partitions.
+  uint64_t bytes = 0;
+  // Bytes of the memory budget held by the insert, released once the
+  // response is written or dropped.
+  uint64_t reserved_bytes = 0;
+};
+
+using HazelcastPendingInsertPtr = std::unique_ptr<HazelcastPendingInsert>;
+
+/**
+ * Write-behind queue of the insert path.
+ *
+ * Insert contexts collect the entries of a response and push them here
+ * once the response completes, instead of writing each partition as
+ * it streams in. A background thread takes the queued responses when
+ * max_batch_bytes are queued or max_delay_ms has passed, and writes
+ * them one putAll batch of at most max_batch_bytes after another.
+ * The client splits each batch by partition owner itself.
+ *
+ * Header entries are written after all partitions of their response
+ * are acknowledged, hence a lookup never finds a header whose body is
+ * incomplete. A response any partition of which fails is not
+ * committed. Of the responses for the same key taken together, the
+ * last one is written and the others are superseded, i.e. dropped
+ * entirely, so that a header is never committed over the partitions
+ * of another response.
+ *
+ * Each worker has its own bounded queue. A push locks the queue of its
+ * worker only, which the background thread takes once per flush, so
+ * workers never wait on each other. The bound per worker also keeps a
+ * worker with many large responses from filling the queue of the
+ * others. Responses pushed to a full queue are dropped, i.e. not
+ * cached; inserts larger than the whole queue abort while streaming
+ * (see maxQueuedBytes). Queued responses are written before the queue
+ * is destroyed.
+ *
+ * Queued responses keep the memory they reserved on the budget of the
+ * inserts (see HazelcastMemoryBudget), until their partitions are
+ * written or they are dropped.
+ *
+ * The insert rate limit applies here rather than while responses
+ * stream in: each taken response takes its stored bytes from the
+ * limiter before it is batched, and is dropped if they do not pass.
+ */
+class HazelcastWriteBehindQueue {
+public:
+  HazelcastWriteBehindQueue(const WriteBehindConfig& config,
+      StorageBackend& backend, HazelcastMemoryBudget& memory_budget,
+      HazelcastRateLimiter& rate_limiter,
+      HazelcastOperationStats& operation_stats);
+  ~HazelcastWriteBehindQueue();
+
+  static bool enabled(const WriteBehindConfig& config) {
+    return config.max_queued_bytes() > 0;
+  }
+
+  // Queues a complete response. False if the queue of the calling
+  // worker is full, then the response is dropped.
+  bool push(HazelcastPendingInsertPtr&& insert);
+
+  // Writes the queued responses on the calling thread before returning.
+  // Intended for tests.
+  void flush();
+
+  // Bytes a worker may queue. A response with more bytes is never
+  // queued, hence its insert is aborted once it exceeds them.
+  uint64_t maxQueuedBytes() const { return max_queued_bytes_; }
+
+  // Responses and their bytes currently queued, summed over workers.
+  uint64_t queuedInserts() const { return queued_inserts_.load(); }
+  uint64_t queuedBytes() const { return queued_bytes_.load(); }
+
+  // Number of responses dropped on a full queue, dropped over the
+  // insert rate limit, superseded by a later response for the same
+  // key, committed, and not committed since a write failed. Number of
+  // putAll batches written.
+  uint64_t dropped() const { return dropped_.load(); }
+  uint64_t rateLimited() const { return rate_limited_.load(); }
+  uint64_t superseded() const { return superseded_.load(); }
+  uint64_t committed() const { return committed_.load(); }
+  uint64_t failed() const { return failed_.load(); }
+  uint64_t batches() const { return batches_.load(); }
+
+  static const uint64_t DEFAULT_MAX_BATCH_BYTES = 1024 * 1024;
+  static const uint32_t DEFAULT_MAX_DELAY_MS = 100;
+
+private:
+  struct WorkerQueue {
+    absl::Mutex mutex;
+    std::vector<HazelcastPendingInsertPtr> inserts GUARDED_BY(mutex);
+    uint64_t bytes GUARDED_BY(mutex) = 0;
+  };
+
+  // Loop of the background thread.
+  void run();
+  // Empties the queues of all workers.
+  std::vector<HazelcastPendingInsertPtr> takeAll();
+  // Writes the partitions, then the headers of the responses whose
+  // partitions are all stored.
+  void write(std::vector<HazelcastPendingInsertPtr>&& inserts);
+  // Writes the headers at the given position of the responses not
+  // failed yet.
+  void writeHeaders(std::vector<HazelcastPendingInsertPtr>& inserts,
+      std::vector<bool>& failed, size_t position);
+
+  const uint64_t max_queued_bytes_;
+  const uint64_t max_batch_bytes_;
+  const std::chrono::milliseconds max_delay_;
+  StorageBackend& backend_;
+  HazelcastMemoryBudget& memory_budget_;
+  HazelcastRateLimiter& rate_limiter_;
+  HazelcastOperationStats& operation_stats_;
+  HazelcastThreadShards<WorkerQueue> workers_;
+
+  // Held while writing, so that flush() and the background thread do
+  // not write at the same time.
+  absl::Mutex write_mutex_;
+
+  absl::Mutex flusher_mutex_;
+  // Wakes the background thread before max_delay_ms.
+  bool wake_ GUARDED_BY(flusher_mutex_) = false;
+  bool stopping_ GUARDED_BY(flusher_mutex_) = false;
+  std::thread flusher_;
+
+  std::atomic<uint64_t> queued_inserts_{0};
+  std::atomic<uint64_t> queued_bytes_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> rate_limited_{0};
+  std::atomic<uint64_t> superseded_{0};
+  std::atomic<uint64_t> committed_{0};
+  std::atomic<uint64_t> failed_{0};
+  std::atomic<uint64_t> batches_{0};
+};
+
+using HazelcastWriteBehindQueuePtr = std::unique_ptr<HazelcastWriteBehindQueue>;
+
+} // namespace Cache
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy